@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libPLCL.hpp>
+#include <libPLCLToWeb.hpp>
+
+#include "Corpus.hpp"
+#include "Documents.hpp"
+#include "Build.hpp"
+#include "CSS.hpp"
+#include "Cli.hpp"
+#include "Diagnostics.hpp"
+#include "Escape.hpp"
+#include "HTML.hpp"
+
+using namespace PLCL;
+
+namespace {
+
+struct Options {
+    std::string filter;
+    std::chrono::milliseconds minTime{500};
+    std::filesystem::path save;
+    std::filesystem::path compare;
+    double threshold = 10; // in percent
+    std::filesystem::path examples = PLCLToWeb_EXAMPLES_DIR;
+};
+
+struct Benchmark {
+    std::string name;
+    // processed by one run, for the throughput
+    size_t bytes;
+    size_t elements;
+    std::function<void()> run;
+};
+
+struct Measurement {
+    double nsPerIteration;
+    double mbPerSecond;
+    double elementsPerSecond;
+};
+
+// read by nothing, keeps the compiler from dropping the work
+volatile size_t consumed = 0;
+
+void consume(size_t value) {
+    consumed = consumed + value;
+}
+
+// runs batches long enough to time reliably and keeps the fastest, which is the least disturbed one
+Measurement measure(const Benchmark &benchmark, std::chrono::milliseconds minTime) {
+    using Clock = std::chrono::steady_clock;
+    constexpr int BATCHES = 5;
+    benchmark.run();
+    size_t iterations = 1;
+    for (;;) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            benchmark.run();
+        }
+        if (Clock::now() - start >= minTime / BATCHES) {
+            break;
+        }
+        iterations *= 2;
+    }
+    double best = 0;
+    for (int batch = 0; batch < BATCHES; batch++) {
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            benchmark.run();
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(iterations);
+        if (batch == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return {best, static_cast<double>(benchmark.bytes) / best * 1e9 / (1024 * 1024), static_cast<double>(benchmark.elements) / best * 1e9};
+}
+
+// compileFile over the files, without the build cache
+Benchmark fileBenchmark(std::string name, std::vector<std::filesystem::path> files) {
+    std::ranges::sort(files);
+    size_t bytes = 0;
+    size_t elements = 0;
+    for (const auto &file : files) {
+        std::ifstream ifs(file);
+        std::string content((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+        std::string output;
+        PLCLToWeb::Options compileOptions;
+        compileOptions.path = file;
+        bytes += content.size();
+        elements += PLCLToWeb::compile(content, *PLCLToWeb::languageOf(file), compileOptions, output).statistics.elements;
+    }
+    std::filesystem::path output = std::filesystem::temp_directory_path() / "PLCLToWeb_bench" / "output";
+    std::filesystem::create_directories(output);
+    std::string outputArgument = output.string();
+    char executable[] = "PLCLToWeb_bench";
+    char noCache[] = "--no-cache";
+    char outputOption[] = "-o";
+    char *argv[] = {executable, noCache, outputOption, outputArgument.data()};
+    auto cli = std::make_shared<Cli>(4, argv);
+    return {std::move(name), bytes, elements, [cli, files = std::move(files)] {
+        for (const auto &file : files) {
+            consume(compileFile(file, *cli, nullptr));
+        }
+    }};
+}
+
+// parses the documents once, the benchmarks only time the renderers. Only what --filter selects is
+// generated, parsed and written, the corpus alone takes longer than most benchmarks.
+std::vector<Benchmark> benchmarks(const Options &options, std::vector<std::unique_ptr<Config::ConfigRoot>> &roots) {
+    std::vector<Benchmark> result;
+    auto selected = [&options](std::string_view name) {
+        return name.find(options.filter) != std::string_view::npos;
+    };
+    auto parse = [&roots](const Document &document) {
+        return roots.emplace_back(std::make_unique<Config::ConfigRoot>(Config::ConfigRoot::fromString(document.source))).get();
+    };
+    // elements is what elements/s counts, the parsed elements unless given
+    auto html = [&](std::string name, const std::function<Document()> &generate, size_t elements = 0) {
+        if (!selected(name)) {
+            return;
+        }
+        Document document = generate();
+        const Config::ConfigRoot *root = parse(document);
+        result.push_back({std::move(name), document.source.size(), elements != 0 ? elements : document.elements, [root] {
+            consume(parseHTML(*root, true, 4).size());
+        }});
+    };
+
+    if (selected("attributeHelper") || selected("kebabCase")) {
+        Document attributes = attributeDocument(1000);
+        const Config::ConfigRoot *attributeRoot = parse(attributes);
+        if (selected("attributeHelper")) {
+            result.push_back({"attributeHelper", attributes.source.size(), 1000, [attributeRoot] {
+                std::string output;
+                for (const auto &attribute : attributeRoot->elements[0]->attributes) {
+                    attributeHelper(attribute, output);
+                }
+                consume(output.size());
+            }});
+        }
+        // the conversion attributeHelper only pays for once per name
+        if (selected("kebabCase")) {
+            result.push_back({"kebabCase", attributes.source.size(), 1000, [attributeRoot] {
+                std::string output;
+                for (const auto &attribute : attributeRoot->elements[0]->attributes) {
+                    kebabCase(attribute->name, output);
+                }
+                consume(output.size());
+            }});
+        }
+    }
+    // mostly clean text, the common case the escaper's fast path is for
+    if (selected("escapeHTML")) {
+        std::string text;
+        for (size_t i = 0; text.size() < 1024 * 1024; i++) {
+            text += i % 64 == 0 ? "Fish & chips < 5 " : "the quick brown fox jumps over the lazy dog ";
+        }
+        result.push_back({"escapeHTML", text.size(), 1, [text = std::move(text)] {
+            std::string output;
+            escapeHTML(text, EscapeContext::TEXT, output);
+            consume(output.size());
+        }});
+    }
+    html("listHelper/wide", [] { return wideDocument(10000); });
+    html("listHelper/deep", [] { return deepDocument(200); });
+    html("templateHelper/variables", [] { return templateDocument(64, 500); });
+    // counts the expanded items
+    html("_BindingLoop/large", [] { return loopDocument(20000); }, 20000);
+
+    if (selected("parseCSS/templates")) {
+        Document css = cssDocument(2000, 4);
+        const Config::ConfigRoot *cssRoot = parse(css);
+        result.push_back({"parseCSS/templates", css.source.size(), css.elements, [cssRoot] {
+            consume(parseCSS(*cssRoot, true, 4).size());
+        }});
+    }
+
+    // end to end, reading and writing included
+    if (selected("compileFile/examples")) {
+        std::vector<std::filesystem::path> examples;
+        if (std::filesystem::is_directory(options.examples)) {
+            for (const auto &entry : std::filesystem::directory_iterator(options.examples)) {
+                if (PLCLToWeb::languageOf(entry.path())) {
+                    examples.push_back(entry.path());
+                }
+            }
+        }
+        if (!examples.empty()) {
+            result.push_back(fileBenchmark("compileFile/examples", std::move(examples)));
+        } else {
+            std::cerr << "No examples found in " << options.examples.string() << ", skipping compileFile/examples" << std::endl;
+        }
+    }
+    if (selected("compileFile/corpus")) {
+        std::filesystem::path corpus = std::filesystem::temp_directory_path() / "PLCLToWeb_bench" / "corpus";
+        std::vector<std::filesystem::path> pages;
+        for (const auto &file : corpusFiles(CorpusShape())) {
+            // the libraries are only compiled as imports
+            if (file.parent_path().empty()) {
+                pages.push_back(corpus / file);
+            }
+        }
+        if (writeCorpus(CorpusShape(), 1, corpus)) {
+            result.push_back(fileBenchmark("compileFile/corpus", std::move(pages)));
+        } else {
+            std::cerr << "Failed to write the corpus to " << corpus.string() << ", skipping compileFile/corpus" << std::endl;
+        }
+    }
+    return result;
+}
+
+// reads the nsPerIteration of every benchmark from a file written by --save
+std::map<std::string, double> loadBaseline(const std::filesystem::path &file) {
+    std::map<std::string, double> result;
+    std::ifstream ifs(file);
+    if (!ifs) {
+        std::cerr << "Failed to open " << file.string() << std::endl;
+        std::exit(1);
+    }
+    std::string content((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+    static const std::regex ENTRY(R"re("([^"]+)"\s*:\s*\{\s*"nsPerIteration"\s*:\s*([0-9.eE+-]+))re");
+    for (auto it = std::sregex_iterator(content.begin(), content.end(), ENTRY); it != std::sregex_iterator(); ++it) {
+        result[(*it)[1].str()] = std::stod((*it)[2].str());
+    }
+    return result;
+}
+
+bool saveBaseline(const std::filesystem::path &file, const std::vector<std::pair<std::string, Measurement>> &measurements) {
+    std::ofstream ofs(file);
+    ofs << std::setprecision(10) << "{\n  \"benchmarks\": {\n";
+    for (size_t i = 0; i < measurements.size(); i++) {
+        const auto &[name, measurement] = measurements[i];
+        ofs << "    \"" << name << "\": {\"nsPerIteration\": " << measurement.nsPerIteration
+            << ", \"mbPerSecond\": " << measurement.mbPerSecond
+            << ", \"elementsPerSecond\": " << measurement.elementsPerSecond << "}"
+            << (i + 1 < measurements.size() ? ",\n" : "\n");
+    }
+    ofs << "  }\n}\n";
+    return static_cast<bool>(ofs);
+}
+
+Options parseOptions(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && hasValue) {
+            options.minTime = std::chrono::milliseconds(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--save") == 0 && hasValue) {
+            options.save = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && hasValue) {
+            options.compare = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            options.threshold = std::stod(argv[++i]);
+        } else if (strcmp(argv[i], "--examples") == 0 && hasValue) {
+            options.examples = argv[++i];
+        } else {
+            std::cout << "Usage: " << argv[0] << " [options]\n"
+            "Options:\n"
+            "  --filter <text>  Only run the benchmarks whose name contains <text>\n"
+            "  --min-time <ms>  Time every benchmark for at least <ms>, defaults to 500\n"
+            "  --save <path>  Save the results as a baseline\n"
+            "  --compare <path>  Compare with a saved baseline and fail on regressions\n"
+            "    --threshold <percent>  Slowdown counted as a regression, defaults to 10\n"
+            "  --examples <path>  Directory of the end-to-end corpus, defaults to the examples"
+            << std::endl;
+            std::exit(strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    Options options = parseOptions(argc, argv);
+    // the documents are valid, anything the renderers report would only skew the timings
+    std::ostream discard(nullptr);
+    DiagnosticsRedirect redirect(discard);
+
+    std::map<std::string, double> baseline;
+    if (!options.compare.empty()) {
+        baseline = loadBaseline(options.compare);
+    }
+    std::vector<std::unique_ptr<Config::ConfigRoot>> roots;
+    std::vector<std::pair<std::string, Measurement>> measurements;
+    bool regressed = false;
+    std::cout << std::left << std::setw(28) << "Benchmark" << std::right << std::setw(14) << "Time/run" << std::setw(12) << "MB/s"
+              << std::setw(16) << "Elements/s" << (baseline.empty() ? "" : "      Change") << '\n';
+    for (const auto &benchmark : benchmarks(options, roots)) {
+        Measurement measurement = measure(benchmark, options.minTime);
+        measurements.emplace_back(benchmark.name, measurement);
+        std::cout << std::left << std::setw(28) << benchmark.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(11) << measurement.nsPerIteration / 1000 << " us" << std::setw(12) << measurement.mbPerSecond
+                  << std::setw(16) << std::setprecision(0) << measurement.elementsPerSecond;
+        if (auto it = baseline.find(benchmark.name); it != baseline.end()) {
+            // positive is slower
+            double change = (measurement.nsPerIteration / it->second - 1) * 100;
+            std::cout << std::setw(10) << std::setprecision(1) << std::showpos << change << std::noshowpos << " %";
+            if (change > options.threshold) {
+                std::cout << " REGRESSION";
+                regressed = true;
+            }
+        }
+        std::cout << std::endl;
+    }
+    if (!options.save.empty() && !saveBaseline(options.save, measurements)) {
+        std::cerr << "Failed to write " << options.save.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (regressed) {
+        std::cerr << "Slower than the baseline by more than " << options.threshold << " %" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
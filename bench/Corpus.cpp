@@ -0,0 +1,360 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <array>
+#include <fstream>
+#include <random>
+#include <string_view>
+
+#include "Corpus.hpp"
+#include "Documents.hpp"
+
+namespace {
+
+constexpr std::string_view COMPONENTS_PATH = "lib/components.p(l)clhtml";
+constexpr std::string_view SHARED_PATH = "lib/shared.p(l)clcss";
+
+constexpr std::string_view WORDS[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliett", "kilo", "lima", "mike", "november", "oscar", "papa",
+    "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray",
+    "yankee", "zulu", "amber", "cobalt", "indigo", "jade", "scarlet", "umber",
+};
+constexpr std::string_view CONTAINERS[] = {"Div", "Section", "Article", "Aside", "Nav", "Header", "Footer"};
+constexpr std::string_view INLINE_ELEMENTS[] = {"P", "Span", "Strong", "Em", "A", "Img"};
+constexpr std::string_view TAGS[] = {"div", "p", "a", "span", "ul", "li", "h1", "h2", "button", "input"};
+constexpr std::string_view PSEUDOCLASSES[] = {"Hover", "Focus", "Active", "Visited", "FirstChild", "LastChild", "Disabled", "Checked"};
+constexpr std::string_view PSEUDOELEMENTS[] = {"Before", "After"};
+constexpr std::array<std::pair<std::string_view, std::array<std::string_view, 3>>, 8> PROPERTIES = {{
+    {"Color", {"#0a0a0a", "#fcfcfc", "rebeccapurple"}},
+    {"BackgroundColor", {"#ffffff", "#202020", "transparent"}},
+    {"Margin", {"0", "4px 8px", "auto"}},
+    {"Padding", {"2px", "8px 16px", "1em"}},
+    {"Display", {"flex", "block", "inline-block"}},
+    {"FontFamily", {"'Poppins', sans-serif", "serif", "monospace"}},
+    {"BorderRadius", {"4px", "50%", "0"}},
+    {"TextAlign", {"left", "center", "right"}},
+}};
+
+// mt19937_64 produces the same sequence everywhere, unlike the standard distributions
+class Random {
+public:
+    explicit Random(uint64_t seed) : engine(seed) {}
+
+    size_t below(size_t bound) {
+        return static_cast<size_t>(engine() % bound);
+    }
+
+    template<typename T, size_t N>
+    const T &pick(const T (&values)[N]) {
+        return values[below(N)];
+    }
+
+    std::string words(size_t minimum, size_t maximum) {
+        size_t count = minimum + below(maximum - minimum + 1);
+        std::string result;
+        for (size_t i = 0; i < count; i++) {
+            if (i != 0) {
+                result.push_back(' ');
+            }
+            result += pick(WORDS);
+        }
+        return result;
+    }
+
+private:
+    std::mt19937_64 engine;
+};
+
+void text(DocumentWriter &writer, std::string_view content) {
+    writer.beginElement("_Text");
+    writer.attribute("Content", content);
+    writer.endElement();
+}
+
+void bindingText(DocumentWriter &writer, std::string_view source) {
+    writer.beginElement("_Text");
+    writer.beginList("_Bindings");
+    writer.beginElement("Binding");
+    writer.attribute("Source", source);
+    writer.attribute("Target", "Content");
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+}
+
+void imports(DocumentWriter &writer, std::string_view path) {
+    writer.beginList("_Imports");
+    writer.beginElement("Import");
+    writer.attribute("Path", path);
+    writer.endElement();
+    writer.endList();
+}
+
+bool hasLoop(const CorpusShape &shape, size_t templateIndex) {
+    return shape.loopLength > 0 && templateIndex % 2 == 0;
+}
+
+void componentsLibrary(DocumentWriter &writer, const CorpusShape &shape, Random &random) {
+    writer.beginList("_Templates");
+    for (size_t t = 0; t < shape.templates; t++) {
+        writer.beginElement("Template");
+        writer.attribute("Name", "Component" + std::to_string(t));
+        writer.beginList("Variables");
+        for (size_t v = 0; v < shape.variables; v++) {
+            writer.beginElement("Variable");
+            writer.attribute("Name", "Field" + std::to_string(v));
+            writer.attribute("Default", random.words(1, 2));
+            writer.endElement();
+        }
+        writer.endList();
+        writer.beginList("Elements");
+        writer.beginElement(random.pick(CONTAINERS));
+        writer.attribute("Class", "component-" + std::to_string(t));
+        if (shape.variables > 0) {
+            writer.beginList("_Bindings");
+            writer.beginElement("Binding");
+            writer.attribute("Source", "Field0");
+            writer.attribute("Target", "DataField");
+            writer.endElement();
+            writer.endList();
+        }
+        writer.beginList("Elements");
+        for (size_t v = 0; v < shape.variables; v++) {
+            writer.beginElement(v == 0 ? "H2" : "P");
+            writer.beginList("Elements");
+            bindingText(writer, "Field" + std::to_string(v));
+            writer.endList();
+            writer.endElement();
+        }
+        if (hasLoop(shape, t)) {
+            writer.beginElement("Ul");
+            writer.beginList("Elements");
+            writer.beginElement("_BindingLoop");
+            writer.attribute("Source", "Items");
+            writer.beginList("Elements");
+            writer.beginElement("Li");
+            writer.beginList("Elements");
+            bindingText(writer, "Items");
+            writer.endList();
+            writer.endElement();
+            writer.endList();
+            writer.endElement();
+            writer.endList();
+            writer.endElement();
+        }
+        writer.endList();
+        writer.endElement();
+        writer.endList();
+        writer.endElement();
+    }
+    writer.endList();
+}
+
+void inlineElement(DocumentWriter &writer, Random &random) {
+    std::string_view type = random.pick(INLINE_ELEMENTS);
+    writer.beginElement(type);
+    if (type == "Img") {
+        writer.attribute("Src", random.words(1, 1) + ".webp");
+        writer.attribute("Alt", random.words(2, 4));
+        writer.endElement();
+        return;
+    }
+    if (type == "A") {
+        writer.attribute("Href", "#" + random.words(1, 1));
+    }
+    writer.beginList("Elements");
+    text(writer, random.words(3, 12));
+    writer.endList();
+    writer.endElement();
+}
+
+void page(DocumentWriter &writer, const CorpusShape &shape, size_t index, Random &random) {
+    imports(writer, COMPONENTS_PATH);
+    writer.beginElement("Doctype");
+    writer.attribute("Content", "html");
+    writer.endElement();
+
+    writer.beginElement("Html");
+    writer.attribute("Lang", "en");
+    writer.beginList("Elements");
+    writer.beginElement("Head");
+    writer.beginList("Elements");
+    writer.beginElement("Title");
+    writer.beginList("Elements");
+    text(writer, "Page " + std::to_string(index));
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+
+    writer.beginElement("Body");
+    writer.attribute("Class", "page");
+    writer.beginList("Elements");
+    // nested section
+    for (size_t level = 0; level < shape.depth; level++) {
+        writer.beginElement(random.pick(CONTAINERS));
+        writer.attribute("Class", random.words(1, 1));
+        writer.beginList("Elements");
+        text(writer, random.words(2, 6));
+    }
+    for (size_t level = 0; level < shape.depth; level++) {
+        writer.endList();
+        writer.endElement();
+    }
+    // wide section
+    writer.beginElement("Main");
+    writer.beginList("Elements");
+    for (size_t i = 0; i < shape.width; i++) {
+        inlineElement(writer, random);
+    }
+    writer.endList();
+    writer.endElement();
+    // components
+    for (size_t i = 0; shape.templates > 0 && i < shape.instantiations; i++) {
+        size_t t = random.below(shape.templates);
+        writer.beginElement("Component" + std::to_string(t));
+        for (size_t v = 0; v < shape.variables; v++) {
+            // leaving some variables at their default exercises the template's Variables list
+            if (random.below(4) != 0) {
+                writer.attribute("Field" + std::to_string(v), random.words(1, 5));
+            }
+        }
+        if (hasLoop(shape, t)) {
+            writer.beginList("VariableValues");
+            writer.beginElement("VariableValue");
+            writer.attribute("Name", "Items");
+            writer.attribute("Type", "LiteralArray");
+            writer.beginList("Value");
+            writer.beginElement("_LiteralList");
+            for (size_t j = 0; j < shape.loopLength; j++) {
+                writer.attribute("Element" + std::to_string(j), random.words(1, 3));
+            }
+            writer.endElement();
+            writer.endList();
+            writer.endElement();
+            writer.endList();
+        }
+        writer.endElement();
+    }
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+}
+
+void properties(DocumentWriter &writer, Random &random, size_t minimum, size_t maximum) {
+    size_t count = minimum + random.below(maximum - minimum + 1);
+    size_t first = random.below(PROPERTIES.size());
+    // consecutive properties, so none is set twice
+    for (size_t i = 0; i < count && i < PROPERTIES.size(); i++) {
+        const auto &[name, values] = PROPERTIES[(first + i) % PROPERTIES.size()];
+        writer.attribute(name, values[random.below(values.size())]);
+    }
+}
+
+void sharedStyles(DocumentWriter &writer, const CorpusShape &shape, Random &random) {
+    writer.beginList("_Templates");
+    for (size_t t = 0; t < shape.cssTemplates; t++) {
+        writer.beginElement("Mixin" + std::to_string(t));
+        properties(writer, random, 2, 4);
+        writer.endElement();
+    }
+    writer.endList();
+}
+
+void stylesheet(DocumentWriter &writer, const CorpusShape &shape, Random &random) {
+    imports(writer, SHARED_PATH);
+    for (size_t r = 0; r < shape.rules; r++) {
+        switch (random.below(3)) {
+            case 0:
+                writer.beginElement(random.pick(TAGS));
+                writer.attribute("_Type", "Tag");
+                break;
+            case 1:
+                writer.beginElement("Block" + std::to_string(r));
+                writer.attribute("_Type", "Class");
+                break;
+            default:
+                writer.beginElement("Region" + std::to_string(r));
+                writer.attribute("_Type", "Id");
+                break;
+        }
+        properties(writer, random, 2, 5);
+        if (shape.cssTemplates > 0 && random.below(2) == 0) {
+            writer.beginList("_Templates");
+            writer.beginElement("Template");
+            writer.attribute("Name", "Mixin" + std::to_string(random.below(shape.cssTemplates)));
+            writer.endElement();
+            writer.endList();
+        }
+        if (shape.pseudoclasses > 0) {
+            writer.beginList("_Pseudoclasses");
+            for (size_t p = 0; p < shape.pseudoclasses; p++) {
+                writer.beginElement(PSEUDOCLASSES[p % std::size(PSEUDOCLASSES)]);
+                properties(writer, random, 1, 2);
+                writer.endElement();
+            }
+            writer.endList();
+        }
+        if (random.below(4) == 0) {
+            writer.beginList("_Pseudoelements");
+            writer.beginElement(random.pick(PSEUDOELEMENTS));
+            // pseudo-elements don't inherit the rule's _Type
+            writer.attribute("_Type", "Tag");
+            writer.attribute("Content", "'" + random.words(1, 1) + "'");
+            writer.endElement();
+            writer.endList();
+        }
+        writer.endElement();
+    }
+}
+
+// streams the document generate writes into the file, named after its stem
+template<typename F>
+bool writeFile(const std::filesystem::path &directory, const std::filesystem::path &file, F &&generate) {
+    std::filesystem::path path = directory / file;
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs) {
+        return false;
+    }
+    DocumentWriter writer(file.stem().string(), &ofs);
+    generate(writer);
+    return writer.flush();
+}
+
+std::filesystem::path pagePath(size_t index) {
+    return "page" + std::to_string(index) + ".p(l)clhtml";
+}
+
+std::filesystem::path stylesheetPath(size_t index) {
+    return "styles" + std::to_string(index) + ".p(l)clcss";
+}
+
+}
+
+std::vector<std::filesystem::path> corpusFiles(const CorpusShape &shape) {
+    std::vector<std::filesystem::path> result = {COMPONENTS_PATH, SHARED_PATH};
+    for (size_t i = 0; i < shape.pages; i++) {
+        result.push_back(pagePath(i));
+        result.push_back(stylesheetPath(i));
+    }
+    return result;
+}
+
+bool writeCorpus(const CorpusShape &shape, uint64_t seed, const std::filesystem::path &directory) {
+    Random random(seed);
+    // one file after the other in the order of corpusFiles, they share the random sequence
+    if (!writeFile(directory, COMPONENTS_PATH, [&](DocumentWriter &writer) { componentsLibrary(writer, shape, random); }) ||
+        !writeFile(directory, SHARED_PATH, [&](DocumentWriter &writer) { sharedStyles(writer, shape, random); })) {
+        return false;
+    }
+    for (size_t i = 0; i < shape.pages; i++) {
+        if (!writeFile(directory, pagePath(i), [&](DocumentWriter &writer) { page(writer, shape, i, random); }) ||
+            !writeFile(directory, stylesheetPath(i), [&](DocumentWriter &writer) { stylesheet(writer, shape, random); })) {
+            return false;
+        }
+    }
+    return true;
+}
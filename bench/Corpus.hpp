@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// The shape of a generated corpus. The counts are exact, the seed only picks names, values,
+// element types and which template every instantiation uses.
+struct CorpusShape {
+    size_t pages = 4;            // .p(l)clhtml files, and as many .p(l)clcss files
+    size_t depth = 16;           // nesting depth of every page's nested section
+    size_t width = 256;          // siblings in every page's wide section
+    size_t templates = 8;        // templates in the shared HTML library
+    size_t variables = 8;        // variables bound by every template
+    size_t instantiations = 64;  // template instantiations per page
+    size_t loopLength = 32;      // literals in every _BindingLoop array, 0 for templates without loops
+    size_t rules = 128;          // rules per stylesheet
+    size_t pseudoclasses = 3;    // _Pseudoclasses per rule
+    size_t cssTemplates = 4;     // templates in the shared CSS library
+};
+
+// the files writeCorpus writes, relative to the corpus directory. The shared libraries are in lib/,
+// so *.p(l)clhtml only matches pages
+std::vector<std::filesystem::path> corpusFiles(const CorpusShape &shape);
+// streams the files below directory one at a time, so a corpus never has to fit in memory. The
+// same shape and seed give the same files on every platform. Returns false if one couldn't be written
+bool writeCorpus(const CorpusShape &shape, uint64_t seed, const std::filesystem::path &directory);
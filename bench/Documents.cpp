@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+
+#include "Documents.hpp"
+
+DocumentWriter::DocumentWriter(std::string_view name, std::ostream *stream) : stream(stream) {
+    source.append("ConfigName ").append(name).append("\n\n");
+}
+
+void DocumentWriter::line(std::string_view text) {
+    source.append(std::min(frames.size(), MAX_INDENT_LEVELS) * 4, ' ').append(text).push_back('\n');
+    if (stream != nullptr && source.size() >= FLUSH_SIZE) {
+        flush();
+    }
+}
+
+void DocumentWriter::beginElement(std::string_view type) {
+    if (!frames.empty() && frames.back().list) {
+        line("ConfigListElement " + std::to_string(frames.back().next++));
+        frames.push_back({false});
+    }
+    line("ConfigElement " + std::string(type));
+    frames.push_back({false});
+    elementCount++;
+}
+
+void DocumentWriter::endElement() {
+    frames.pop_back();
+    line("endConfigElement");
+    // closes the ConfigListElement opened for it
+    if (frames.size() >= 2 && !frames.back().list && frames[frames.size() - 2].list) {
+        frames.pop_back();
+        line("endConfigListElement");
+    }
+    if (frames.empty()) {
+        source.push_back('\n');
+    }
+}
+
+void DocumentWriter::beginList(std::string_view type) {
+    line("ConfigList " + std::string(type));
+    frames.push_back({true});
+}
+
+void DocumentWriter::endList() {
+    frames.pop_back();
+    line("endConfigList");
+    if (frames.empty()) {
+        source.push_back('\n');
+    }
+}
+
+void DocumentWriter::attribute(std::string_view name, std::string_view value) {
+    line(std::string(name) + " = \"" + std::string(value) + "\"");
+}
+
+void DocumentWriter::attribute(std::string_view name, int64_t value) {
+    line(std::string(name) + " = " + std::to_string(value));
+}
+
+void DocumentWriter::attribute(std::string_view name, double value) {
+    line(std::string(name) + " = " + std::to_string(value));
+}
+
+void DocumentWriter::attribute(std::string_view name, bool value) {
+    line(std::string(name) + " = " + (value ? "True" : "False"));
+}
+
+std::string DocumentWriter::take() {
+    return std::move(source);
+}
+
+bool DocumentWriter::flush() {
+    if (stream == nullptr) {
+        return true;
+    }
+    stream->write(source.data(), static_cast<std::streamsize>(source.size()));
+    source.clear();
+    return static_cast<bool>(*stream);
+}
+
+namespace {
+
+Document finish(DocumentWriter &writer) {
+    size_t elements = writer.elements();
+    return {writer.take(), elements};
+}
+
+void text(DocumentWriter &writer, std::string_view content) {
+    writer.beginElement("_Text");
+    writer.attribute("Content", content);
+    writer.endElement();
+}
+
+}
+
+Document attributeDocument(size_t attributes) {
+    DocumentWriter writer("attributes");
+    writer.beginElement("Html");
+    for (size_t i = 0; i < attributes; i++) {
+        std::string name = "DataAttribute" + std::to_string(i);
+        switch (i % 4) {
+            case 0: writer.attribute(name, "value " + std::to_string(i)); break;
+            case 1: writer.attribute(name, static_cast<int64_t>(i)); break;
+            case 2: writer.attribute(name, static_cast<double>(i) / 8); break;
+            default: writer.attribute(name, true); break;
+        }
+    }
+    writer.endElement();
+    return finish(writer);
+}
+
+Document wideDocument(size_t width) {
+    DocumentWriter writer("wide");
+    writer.beginElement("Html");
+    writer.beginList("Elements");
+    writer.beginElement("Body");
+    writer.beginList("Elements");
+    for (size_t i = 0; i < width; i++) {
+        writer.beginElement("P");
+        writer.attribute("Class", "item");
+        writer.beginList("Elements");
+        text(writer, "Paragraph " + std::to_string(i));
+        writer.endList();
+        writer.endElement();
+    }
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    return finish(writer);
+}
+
+Document deepDocument(size_t depth) {
+    DocumentWriter writer("deep");
+    writer.beginElement("Html");
+    for (size_t i = 0; i < depth; i++) {
+        writer.beginList("Elements");
+        text(writer, "Level " + std::to_string(i));
+        writer.beginElement("Div");
+    }
+    for (size_t i = 0; i < depth; i++) {
+        writer.endElement();
+        writer.endList();
+    }
+    writer.endElement();
+    return finish(writer);
+}
+
+Document templateDocument(size_t variables, size_t instantiations) {
+    DocumentWriter writer("templates");
+    writer.beginList("_Templates");
+    writer.beginElement("Template");
+    writer.attribute("Name", "Component");
+    writer.beginList("Variables");
+    for (size_t i = 0; i < variables; i++) {
+        writer.beginElement("Variable");
+        writer.attribute("Name", "Variable" + std::to_string(i));
+        writer.attribute("Default", "default");
+        writer.endElement();
+    }
+    writer.endList();
+    writer.beginList("Elements");
+    writer.beginElement("Div");
+    writer.beginList("Elements");
+    for (size_t i = 0; i < variables; i++) {
+        writer.beginElement("_Text");
+        writer.beginList("_Bindings");
+        writer.beginElement("Binding");
+        writer.attribute("Source", "Variable" + std::to_string(i));
+        writer.attribute("Target", "Content");
+        writer.endElement();
+        writer.endList();
+        writer.endElement();
+    }
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+
+    writer.beginElement("Html");
+    writer.beginList("Elements");
+    for (size_t i = 0; i < instantiations; i++) {
+        writer.beginElement("Component");
+        for (size_t j = 0; j < variables; j++) {
+            writer.attribute("Variable" + std::to_string(j), "value " + std::to_string(i) + "." + std::to_string(j));
+        }
+        writer.endElement();
+    }
+    writer.endList();
+    writer.endElement();
+    return finish(writer);
+}
+
+Document loopDocument(size_t length) {
+    DocumentWriter writer("loop");
+    writer.beginList("_Templates");
+    writer.beginElement("Template");
+    writer.attribute("Name", "List");
+    writer.beginList("Elements");
+    writer.beginElement("Ul");
+    writer.beginList("Elements");
+    writer.beginElement("_BindingLoop");
+    writer.attribute("Source", "Items");
+    writer.beginList("Elements");
+    writer.beginElement("Li");
+    writer.beginList("Elements");
+    writer.beginElement("_Text");
+    writer.beginList("_Bindings");
+    writer.beginElement("Binding");
+    writer.attribute("Source", "Items");
+    writer.attribute("Target", "Content");
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+
+    writer.beginElement("Html");
+    writer.beginList("Elements");
+    writer.beginElement("List");
+    writer.beginList("VariableValues");
+    writer.beginElement("VariableValue");
+    writer.attribute("Name", "Items");
+    writer.attribute("Type", "LiteralArray");
+    writer.beginList("Value");
+    writer.beginElement("_LiteralList");
+    for (size_t i = 0; i < length; i++) {
+        writer.attribute("Element" + std::to_string(i), "item " + std::to_string(i));
+    }
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    return finish(writer);
+}
+
+Document cssDocument(size_t rules, size_t pseudoclasses) {
+    static constexpr std::string_view PSEUDOCLASSES[] = {"Hover", "Focus", "Active", "Visited", "FirstChild", "LastChild"};
+    DocumentWriter writer("css");
+    writer.beginList("_Templates");
+    writer.beginElement("Spacing");
+    writer.attribute("Padding", "4px 8px");
+    writer.attribute("MarginTop", static_cast<int64_t>(2));
+    writer.endElement();
+    writer.endList();
+    for (size_t i = 0; i < rules; i++) {
+        writer.beginElement("Rule" + std::to_string(i));
+        writer.attribute("_Type", "Class");
+        writer.attribute("Color", "#0a0a0a");
+        writer.attribute("FontWeight", static_cast<int64_t>(400));
+        writer.attribute("LineHeight", 1.25);
+        writer.beginList("_Templates");
+        writer.beginElement("Template");
+        writer.attribute("Name", "Spacing");
+        writer.endElement();
+        writer.endList();
+        writer.beginList("_Pseudoclasses");
+        for (size_t j = 0; j < pseudoclasses; j++) {
+            writer.beginElement(PSEUDOCLASSES[j % std::size(PSEUDOCLASSES)]);
+            writer.attribute("Color", "#fcfcfc");
+            writer.endElement();
+        }
+        writer.endList();
+        writer.beginList("_Pseudoelements");
+        writer.beginElement("Before");
+        writer.attribute("_Type", "Tag");
+        writer.attribute("Content", "'>'");
+        writer.endElement();
+        writer.endList();
+        writer.endElement();
+    }
+    return finish(writer);
+}
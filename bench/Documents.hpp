@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writes P(L)CL source laid out like the examples. Elements inside a list are wrapped in numbered
+// ConfigListElements automatically. Indentation stops growing past MAX_INDENT_LEVELS, so the size
+// of deeply nested documents stays linear in their depth.
+class DocumentWriter {
+public:
+    static constexpr size_t MAX_INDENT_LEVELS = 64;
+    // buffered source written to the stream at once
+    static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+    // without a stream the source is kept for take(), with one it's written out as it grows
+    explicit DocumentWriter(std::string_view name, std::ostream *stream = nullptr);
+
+    void beginElement(std::string_view type);
+    void endElement();
+    void beginList(std::string_view type);
+    void endList();
+    void attribute(std::string_view name, std::string_view value);
+    // string literals would pick the bool overload otherwise
+    void attribute(std::string_view name, const char *value) {
+        attribute(name, std::string_view(value));
+    }
+    void attribute(std::string_view name, int64_t value);
+    void attribute(std::string_view name, double value);
+    void attribute(std::string_view name, bool value);
+
+    [[nodiscard]] size_t elements() const {
+        return elementCount;
+    }
+    [[nodiscard]] std::string take();
+    // writes the buffered source to the stream, returns false if it couldn't be written
+    bool flush();
+
+private:
+    void line(std::string_view text);
+
+    struct Frame {
+        bool list;
+        size_t next = 0;
+    };
+
+    std::string source;
+    std::ostream *stream;
+    std::vector<Frame> frames;
+    size_t elementCount = 0;
+};
+
+struct Document {
+    std::string source;
+    size_t elements;
+};
+
+// one element with attributes of every value type
+Document attributeDocument(size_t attributes);
+// a body with width sibling paragraphs
+Document wideDocument(size_t width);
+// divs nested depth levels deep, each with a _Text
+Document deepDocument(size_t depth);
+// a template with variables bound variables, instantiated instantiations times with different values
+Document templateDocument(size_t variables, size_t instantiations);
+// a template expanding a _BindingLoop over an array of length literals
+Document loopDocument(size_t length);
+// rules using a template, each with pseudoclasses pseudo-classes and a pseudo-element
+Document cssDocument(size_t rules, size_t pseudoclasses);
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "Corpus.hpp"
+
+namespace {
+
+void printHelp(const char *executable) {
+    CorpusShape defaults;
+    std::cout << "Usage: " << executable << " -o <directory> [options]\n"
+    "Writes P(L)CLHTML pages, P(L)CLCSS stylesheets and the libraries they import to <directory>.\n"
+    "The same seed and options always give the same files.\n"
+    "Options:\n"
+    "  --seed <number>  Defaults to 1\n"
+    "  --pages <count>  Pages and stylesheets, defaults to " << defaults.pages << "\n"
+    "  --depth <count>  Nesting depth of every page's nested section, defaults to " << defaults.depth << "\n"
+    "  --width <count>  Siblings in every page's wide section, defaults to " << defaults.width << "\n"
+    "  --templates <count>  Templates in the HTML library, defaults to " << defaults.templates << "\n"
+    "  --variables <count>  Variables per template, defaults to " << defaults.variables << "\n"
+    "  --instantiations <count>  Template instantiations per page, defaults to " << defaults.instantiations << "\n"
+    "  --loop-length <count>  Literals per _BindingLoop array, 0 for no loops, defaults to " << defaults.loopLength << "\n"
+    "  --rules <count>  Rules per stylesheet, defaults to " << defaults.rules << "\n"
+    "  --pseudoclasses <count>  _Pseudoclasses per rule, defaults to " << defaults.pseudoclasses << "\n"
+    "  --css-templates <count>  Templates in the CSS library, defaults to " << defaults.cssTemplates
+    << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    CorpusShape shape;
+    uint64_t seed = 1;
+    std::filesystem::path output;
+    struct {
+        const char *name;
+        size_t *value;
+    } counts[] = {
+        {"--pages", &shape.pages},
+        {"--depth", &shape.depth},
+        {"--width", &shape.width},
+        {"--templates", &shape.templates},
+        {"--variables", &shape.variables},
+        {"--instantiations", &shape.instantiations},
+        {"--loop-length", &shape.loopLength},
+        {"--rules", &shape.rules},
+        {"--pseudoclasses", &shape.pseudoclasses},
+        {"--css-templates", &shape.cssTemplates},
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printHelp(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Expected a value after " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
+            output = argv[++i];
+            continue;
+        }
+        if (!std::isdigit(argv[i + 1][0])) {
+            std::cerr << "Expected positive number after " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--seed") == 0) {
+            seed = std::stoull(argv[++i]);
+            continue;
+        }
+        bool found = false;
+        for (const auto &count : counts) {
+            if (strcmp(argv[i], count.name) == 0) {
+                *count.value = std::stoul(argv[++i]);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (output.empty()) {
+        printHelp(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!writeCorpus(shape, seed, output)) {
+        std::cerr << "Failed to write the corpus to " << output.string() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << corpusFiles(shape).size() << " files to " << output.string() << std::endl;
+    return EXIT_SUCCESS;
+}
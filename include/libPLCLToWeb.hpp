@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In-memory interface of PLCLToWeb, the command line tool is a client of it.
+// Compiling is thread-safe, imported template libraries are parsed once per process and shared.
+namespace PLCLToWeb {
+    enum class Language {
+        HTML, // .p(l)clhtml
+        CSS,  // .p(l)clcss
+    };
+
+    struct Options {
+        bool minify = true;
+        size_t indent = 4;
+        // write P(L)CLHTML as a C++ header with render functions instead of HTML
+        bool emitCpp = false;
+        // render identical template instantiations once and copy them afterwards, P(L)CLHTML only
+        bool fragmentCache = false;
+        // compile and render large P(L)CLHTML documents on up to this many threads of a shared pool, the output is the same
+        size_t renderThreads = 1;
+        // where the source comes from, _Imports are resolved relative to it
+        // without one they're resolved relative to the working directory
+        std::filesystem::path path;
+    };
+
+    struct Diagnostic {
+        // the file, template or element the message is about, empty if the message doesn't name one
+        std::string source;
+        std::string message;
+    };
+
+    struct Statistics {
+        // wall time spent parsing the source, loading its _Imports, rendering it and in the sink
+        std::chrono::nanoseconds parse{0};
+        std::chrono::nanoseconds imports{0};
+        std::chrono::nanoseconds render{0};
+        std::chrono::nanoseconds write{0};
+        size_t bytesIn = 0;
+        size_t bytesOut = 0;
+        // counted in the source, elements and attributes of imported libraries aren't included
+        size_t elements = 0;
+        size_t attributes = 0;
+        size_t templateInstantiations = 0;
+        // template instantiations copied from the fragment cache and rendered into it
+        size_t fragmentCacheHits = 0;
+        size_t fragmentCacheMisses = 0;
+
+        Statistics &operator+=(const Statistics &other) {
+            parse += other.parse;
+            imports += other.imports;
+            render += other.render;
+            write += other.write;
+            bytesIn += other.bytesIn;
+            bytesOut += other.bytesOut;
+            elements += other.elements;
+            attributes += other.attributes;
+            templateInstantiations += other.templateInstantiations;
+            fragmentCacheHits += other.fragmentCacheHits;
+            fragmentCacheMisses += other.fragmentCacheMisses;
+            return *this;
+        }
+    };
+
+    struct Result {
+        // false if the source couldn't be parsed, the output is incomplete then
+        bool success = true;
+        std::vector<Diagnostic> diagnostics;
+        Statistics statistics;
+    };
+
+    // receives the output in order, in chunks of up to 64 KiB
+    typedef std::function<void(std::string_view)> Sink;
+
+    // the language of a file by its extension
+    std::optional<Language> languageOf(const std::filesystem::path &file);
+
+    // appends the output to the buffer
+    Result compile(std::string_view source, Language language, const Options &options, std::string &output);
+    Result compile(std::string_view source, Language language, const Options &options, const Sink &sink);
+
+    // from now on every compile records Trace Event Format spans, for Perfetto or chrome://tracing
+    void startTracing();
+    // writes every span recorded since startTracing as JSON, returns false if the file couldn't be written
+    bool writeTrace(const std::filesystem::path &file);
+
+    // "(source) message", the way the command line tool prints it
+    std::ostream &operator<<(std::ostream &stream, const Diagnostic &diagnostic);
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "Allocations.hpp"
+
+#if defined(__GLIBC__) || defined(_WIN32)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+namespace {
+
+// trivially constructed, so it's safe to use while threads start and exit
+thread_local AllocationTracker *activeTracker = nullptr;
+
+[[maybe_unused]] size_t allocationSize(void *pointer) {
+#if defined(__GLIBC__)
+    return malloc_usable_size(pointer);
+#elif defined(_WIN32)
+    return _msize(pointer);
+#elif defined(__APPLE__)
+    return malloc_size(pointer);
+#else
+    (void) pointer;
+    return 0;
+#endif
+}
+
+}
+
+AllocationTracker::AllocationTracker() : previous(activeTracker) {
+    activeTracker = this;
+}
+
+AllocationTracker::~AllocationTracker() {
+    activeTracker = previous;
+}
+
+AllocationTracker *AllocationTracker::active() {
+    return activeTracker;
+}
+
+void AllocationTracker::allocated(void *pointer) {
+    AllocationTracker *tracker = activeTracker;
+    if (tracker == nullptr) {
+        return;
+    }
+    tracker->count.fetch_add(1, std::memory_order_relaxed);
+#ifdef ALLOCATION_BYTES_SUPPORTED
+    auto size = static_cast<ptrdiff_t>(allocationSize(pointer));
+    ptrdiff_t current = tracker->current.fetch_add(size, std::memory_order_relaxed) + size;
+    ptrdiff_t peak = tracker->peak.load(std::memory_order_relaxed);
+    while (current > peak && !tracker->peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+#else
+    (void) pointer;
+#endif
+}
+
+void AllocationTracker::freed(void *pointer) {
+#ifdef ALLOCATION_BYTES_SUPPORTED
+    AllocationTracker *tracker = activeTracker;
+    if (tracker != nullptr && pointer != nullptr) {
+        tracker->current.fetch_sub(static_cast<ptrdiff_t>(allocationSize(pointer)), std::memory_order_relaxed);
+    }
+#else
+    (void) pointer;
+#endif
+}
+
+AllocationScope::AllocationScope(AllocationTracker *tracker) : previous(activeTracker) {
+    activeTracker = tracker;
+}
+
+AllocationScope::~AllocationScope() {
+    activeTracker = previous;
+}
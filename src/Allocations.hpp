@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#if defined(__GLIBC__) || defined(_WIN32) || defined(__APPLE__)
+#define ALLOCATION_BYTES_SUPPORTED 1
+#endif
+
+// Counts the heap allocations of the current thread while it's alive, along with the ones of pool threads
+// rendering or compiling segments for it, see AllocationScope. The executable replaces the global
+// operator new for it, the library doesn't pay for that. Memory freed by a thread that isn't counting
+// for the tracker, like a helper's fragment cache after its last segment, isn't subtracted from the peak.
+class AllocationTracker {
+public:
+    AllocationTracker();
+    ~AllocationTracker();
+    AllocationTracker(const AllocationTracker &) = delete;
+    AllocationTracker &operator=(const AllocationTracker &) = delete;
+
+    [[nodiscard]] size_t allocations() const {
+        return count.load(std::memory_order_relaxed);
+    }
+    // the most heap in use at once, above what was in use when the tracker started
+    // always 0 where the size of an allocation can't be queried
+    [[nodiscard]] size_t peakBytes() const {
+        ptrdiff_t bytes = peak.load(std::memory_order_relaxed);
+        return bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    }
+
+    // the tracker counting for the current thread, nullptr if there's none
+    static AllocationTracker *active();
+    static void allocated(void *pointer);
+    static void freed(void *pointer);
+
+private:
+    AllocationTracker *previous;
+    // helper threads count into the same tracker, relaxed is enough for totals read after they're done
+    std::atomic<size_t> count = 0;
+    std::atomic<ptrdiff_t> current = 0;
+    std::atomic<ptrdiff_t> peak = 0;
+};
+
+// Counts the current thread's allocations in the tracker, taken from the thread a helper works for,
+// while it's alive. The tracker has to outlive it, which the segment waits of the parallel renderers
+// guarantee. A nullptr tracker stops the counting.
+class AllocationScope {
+public:
+    explicit AllocationScope(AllocationTracker *tracker);
+    ~AllocationScope();
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope &operator=(const AllocationScope &) = delete;
+
+private:
+    AllocationTracker *previous;
+};
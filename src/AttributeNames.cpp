@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <mutex>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "AttributeNames.hpp"
+
+void kebabCase(std::string_view name, std::string &output) {
+    size_t start = output.size();
+    // every byte might get a dash, the string is shrunk to what was written at the end
+    output.resize(start + name.size() * 2);
+    char *out = output.data() + start;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8('a' - 'A');
+    for (; i + 16 <= name.size(); i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(name.data() + i));
+        // signed compares, bytes past ASCII are negative and never uppercase
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, beforeA), _mm_cmplt_epi8(bytes, afterZ));
+        __m128i lower = _mm_or_si128(bytes, _mm_and_si128(upper, caseBit));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(upper));
+        // the first byte of the name never gets a dash
+        if (i == 0) {
+            mask &= ~1u;
+        }
+        if (mask == 0) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lower);
+            out += 16;
+            continue;
+        }
+        alignas(16) char lowered[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lowered), lower);
+        for (size_t j = 0; j < 16; j++) {
+            if (mask & (1u << j)) {
+                *out++ = '-';
+            }
+            *out++ = lowered[j];
+        }
+    }
+#endif
+    for (; i < name.size(); i++) {
+        char c = name[i];
+        if (c >= 'A' && c <= 'Z') {
+            if (i != 0) {
+                *out++ = '-';
+            }
+            c += 'a' - 'A';
+        }
+        *out++ = c;
+    }
+    output.resize(out - output.data());
+}
+
+std::string_view AttributeNames::convert(std::string_view name) {
+    {
+        std::shared_lock lock(mutex);
+        auto it = names.find(name);
+        if (it != names.end()) {
+            return it->second;
+        }
+    }
+    std::string converted;
+    kebabCase(name, converted);
+    std::unique_lock lock(mutex);
+    // another thread might have converted it in the meantime, either conversion is the same
+    return names.try_emplace(std::string(name), std::move(converted)).first->second;
+}
+
+AttributeNames &attributeNames() {
+    static AttributeNames names;
+    return names;
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// ExampleAttributeName -> example-attribute-name, appended to output in a single pass
+void kebabCase(std::string_view name, std::string &output);
+
+// Attribute and CSS property names converted once per process. Documents use the same few hundred
+// names over and over, so every name after the first is a lookup under a shared lock.
+class AttributeNames {
+public:
+    // the view stays valid for as long as the cache
+    std::string_view convert(std::string_view name);
+
+private:
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>()(name);
+        }
+    };
+
+    std::shared_mutex mutex;
+    // by source name, the nodes and with them the converted names never move
+    std::unordered_map<std::string, std::string, NameHash, std::equal_to<>> names;
+};
+
+AttributeNames &attributeNames();
+
+// ExampleAttributeName -> example-attribute-name, through the process-wide cache
+inline std::string_view attributeName(std::string_view name) {
+    return attributeNames().convert(name);
+}
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <sstream>
+#include <unordered_set>
+
+#include "Build.hpp"
+#include "Allocations.hpp"
+#include "Cache.hpp"
+#include "Diagnostics.hpp"
+#include "InputFile.hpp"
+#include "Libraries.hpp"
+#include "OutputFile.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+std::optional<std::filesystem::path> outputFile(const std::filesystem::path &file, const std::filesystem::path &directory, bool emitCpp) {
+    std::optional<PLCLToWeb::Language> language = PLCLToWeb::languageOf(file);
+    if (!language) {
+        return std::nullopt;
+    }
+    std::filesystem::path output = directory / file.stem();
+    if (*language == PLCLToWeb::Language::HTML) {
+        output += emitCpp ? ".hpp" : ".html";
+    } else {
+        output += ".css";
+    }
+    return output;
+}
+
+namespace {
+
+bool buildFile(const std::filesystem::path &file, const Cli &cli, BuildCache *cache, FileStatistics *statistics) {
+    using Clock = std::chrono::steady_clock;
+    std::optional<PLCLToWeb::Language> language = PLCLToWeb::languageOf(file);
+    if (!language) {
+        diagnostics() << "Unknown extension " << file.extension().string() << std::endl;
+        return false;
+    }
+    std::string output = outputFile(file, cli.output, cli.emitCpp)->string();
+    TraceSpan span("file", file.string());
+
+    Clock::time_point start = Clock::now();
+    // under --watch the file gets rewritten by whoever triggers the next build, maybe while it's read
+    std::optional<InputFile> input = InputFile::read(file, cli.watch ? InputFile::Access::Read : InputFile::Access::Map);
+    if (!input) {
+        diagnostics() << "Failed to open " << file.string() << std::endl;
+        return false;
+    }
+    std::string_view content = input->view();
+    if (statistics != nullptr) {
+        statistics->read = Clock::now() - start;
+    }
+    if (cache != nullptr) {
+        // the imports can only differ if the content did, which changes the key anyway
+        std::optional<std::vector<std::filesystem::path>> dependencies = cache->dependencies(file);
+        if (dependencies && cache->upToDate(file, cache->key(content, *dependencies), output)) {
+            // keeps the dependency graph complete for --watch without parsing the file
+            templateLibraries().recordImports(file, *dependencies);
+            if (statistics != nullptr) {
+                statistics->upToDate = true;
+                statistics->compile.bytesIn = content.size();
+            }
+            return true;
+        }
+    }
+
+    // unchanged outputs aren't rewritten, so their modification time stays put
+    OutputFile ofs(output, cli.fsync);
+    PLCLToWeb::Options options{!cli.dontMinify, cli.indent, cli.emitCpp, cli.fragmentCache, cli.renderThreads, file};
+    PLCLToWeb::Result result = PLCLToWeb::compile(content, *language, options, [&ofs](std::string_view chunk) {
+        ofs.write(chunk);
+    });
+    start = Clock::now();
+    // a failed compile leaves the previous output in place, the temporary file is removed
+    bool written = !result.success || ofs.commit();
+    result.statistics.write += Clock::now() - start;
+    for (const auto &diagnostic : result.diagnostics) {
+        diagnostics() << diagnostic << std::endl;
+    }
+    if (statistics != nullptr) {
+        statistics->compile = result.statistics;
+    }
+    if (!written) {
+        diagnostics() << "Failed to open " << output << " for writing" << std::endl;
+    }
+    if (!written || !result.success) {
+        // whatever the output holds now, it isn't what the key says
+        if (cache != nullptr) {
+            cache->erase(file);
+        }
+        return false;
+    }
+    if (cache != nullptr) {
+        std::vector<std::filesystem::path> dependencies = templateLibraries().dependencies(file);
+        cache->store(file, cache->key(content, dependencies), std::move(dependencies), output);
+    }
+    return true;
+}
+
+void reportStatistics(const std::vector<FileStatistics> &statistics, const Cli &cli) {
+    if (cli.stats) {
+        printStatistics(statistics, cli.fragmentCache, std::cout);
+    }
+    if (!cli.statsJson.empty()) {
+        writeStatisticsJson(statistics, cli.statsJson);
+    }
+}
+
+}
+
+bool compileFile(const std::filesystem::path &file, const Cli &cli, BuildCache *cache, FileStatistics *statistics) {
+    if (statistics == nullptr) {
+        return buildFile(file, cli, cache, nullptr);
+    }
+    statistics->file = file;
+    AllocationTracker tracker;
+    bool success = buildFile(file, cli, cache, statistics);
+    statistics->allocations = tracker.allocations();
+    statistics->peakBytes = tracker.peakBytes();
+    return success;
+}
+
+bool compileFiles(const std::vector<std::filesystem::path> &files, const Cli &cli) {
+    bool failed = false;
+    bool collectStatistics = cli.stats || !cli.statsJson.empty();
+    std::vector<FileStatistics> statistics(collectStatistics ? files.size() : 0);
+    std::optional<BuildCache> cache;
+    if (!cli.noCache) {
+        cache.emplace(cli);
+    }
+    BuildCache *cachePointer = cache ? &*cache : nullptr;
+    if (cli.jobs <= 1 || files.size() <= 1) {
+        for (size_t i = 0; i < files.size(); i++) {
+            failed |= !compileFile(files[i], cli, cachePointer, collectStatistics ? &statistics[i] : nullptr);
+        }
+        if (cache) {
+            cache->save();
+        }
+        if (collectStatistics) {
+            reportStatistics(statistics, cli);
+        }
+        return !failed;
+    }
+
+    struct FileResult {
+        bool success;
+        std::string diagnostics;
+    };
+
+    ThreadPool pool(std::min(cli.jobs, files.size()));
+    std::vector<std::future<FileResult>> results;
+    results.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        FileStatistics *fileStatistics = collectStatistics ? &statistics[i] : nullptr;
+        results.push_back(pool.submit([&file = files[i], &cli, cachePointer, fileStatistics] {
+            std::ostringstream stream;
+            DiagnosticsRedirect redirect(stream);
+            bool success = compileFile(file, cli, cachePointer, fileStatistics);
+            return FileResult{success, std::move(stream).str()};
+        }));
+    }
+    // waiting in order keeps the log deterministic while later files are still being compiled
+    for (auto &future : results) {
+        FileResult result = future.get();
+        std::cerr << result.diagnostics << std::flush;
+        failed |= !result.success;
+    }
+    if (cache) {
+        cache->save();
+    }
+    if (collectStatistics) {
+        reportStatistics(statistics, cli);
+    }
+    return !failed;
+}
+
+std::vector<std::filesystem::path> invalidateChanged(const std::vector<std::filesystem::path> &changed, const std::vector<std::filesystem::path> &files) {
+    std::unordered_set<std::filesystem::path, PathHash> affected;
+    for (const auto &file : changed) {
+        templateLibraries().invalidate(file);
+        affected.insert(file);
+        affected.merge(templateLibraries().dependents(file));
+    }
+    std::vector<std::filesystem::path> result;
+    for (const auto &file : files) {
+        if (affected.contains(file)) {
+            result.push_back(file);
+        }
+    }
+    return result;
+}
+
+std::vector<std::filesystem::path> watchedFiles(const std::vector<std::filesystem::path> &files) {
+    std::vector<std::filesystem::path> result = files;
+    std::unordered_set<std::filesystem::path, PathHash> seen(files.begin(), files.end());
+    for (auto &library : templateLibraries().libraries()) {
+        if (seen.insert(library).second && std::filesystem::exists(library)) {
+            result.push_back(std::move(library));
+        }
+    }
+    return result;
+}
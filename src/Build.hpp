@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "Cli.hpp"
+
+class BuildCache;
+struct FileStatistics;
+
+// where compileFile writes the output of the file, nullopt for unknown extensions
+std::optional<std::filesystem::path> outputFile(const std::filesystem::path &file, const std::filesystem::path &directory, bool emitCpp);
+// skips the file if the cache says its output is up to date, the cache may be nullptr
+// statistics is filled in unless it's nullptr, allocations are only tracked then
+bool compileFile(const std::filesystem::path &file, const Cli &cli, BuildCache *cache, FileStatistics *statistics = nullptr);
+// compiles the files on cli.jobs threads, diagnostics are printed in input order
+// unless cli.noCache is set, unchanged files are skipped using the build cache in the output directory
+// with cli.stats or cli.statsJson, statistics of every file are reported afterwards
+// returns false if any of the files failed
+bool compileFiles(const std::vector<std::filesystem::path> &files, const Cli &cli);
+// drops the changed files from the template library cache and returns the files among files that
+// have to be rebuilt, which are the changed ones and the ones importing them, in input order
+std::vector<std::filesystem::path> invalidateChanged(const std::vector<std::filesystem::path> &changed, const std::vector<std::filesystem::path> &files);
+// the files plus every template library they import
+std::vector<std::filesystem::path> watchedFiles(const std::vector<std::filesystem::path> &files);
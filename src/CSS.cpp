@@ -1,137 +1,193 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include "AttributeNames.hpp"
 #include "CSS.hpp"
+#include "Diagnostics.hpp"
+#include "Formatting.hpp"
 #include "Generic.hpp"
+#include "Keywords.hpp"
+#include "Trace.hpp"
 
-std::string elementInsideHelper(const Config::ConfigElement &input, bool minify, size_t indent) {
+template<typename Format>
+std::string elementInsideHelper(const Config::ConfigElement &input, Format format) {
     std::string result;
     for (const auto &attribute : input.attributes) {
         if (attribute->name[0] == '_') {
             continue;
         }
 
-        std::string newName = attribute->name;
-        for (size_t i = 0; i < newName.size(); i++) {
-            if (isupper(newName[i]) && i != 0) {
-                newName.insert(i, "-");
-                i++;
-            }
-        }
-        std::ranges::transform(newName, newName.begin(), ::tolower);
-        if (!minify) {
-            result += std::string(indent, ' ');
-        }
-        result += newName + ":";
-        if (!minify) {
-            result += " ";
-        }
+        format.indentation(result, format.indent());
+        result += attributeName(attribute->name);
+        result += ':';
+        format.space(result);
         result += attributeValueToString(attribute->value);
-        result += ";";
-        if (!minify) {
-            result += "\n";
-        }
+        result += ';';
+        format.lineEnd(result);
     }
     return result;
 }
 
-std::string elementHelper(const Config::ConfigElement &input, const std::string_view& name, const std::map<std::string, std::string> &templates, bool minify, size_t indent) {
-    std::string result;
-    std::string afterMain;
+namespace {
+
+// a rule still to be written, the stack of them replaces recursing into pseudo-classes and pseudo-elements
+struct PendingRule {
+    const Config::ConfigElement *element;
+    // replaces the element's type for pseudo-classes and pseudo-elements, so the parsed tree isn't modified
+    std::string selector;
+    // the _type of the element a pseudo-class belongs to
+    std::optional<std::string> inheritedType;
+};
+
+// writes the rule and pushes its pseudo-classes and pseudo-elements, so they're written right after it
+template<typename Format>
+void elementHelper(const PendingRule &rule, std::vector<PendingRule> &pending, std::string &result, const std::string_view& name, const std::map<std::string, std::string> &templates, Format format, size_t &instantiations) {
+    const Config::ConfigElement &input = *rule.element;
+    const std::string &selector = rule.selector;
+    TraceSpan span("rule", selector);
+    bool all = keyword(selector) == Keyword::ALL;
     std::string type;
+    bool typeFound = false;
     for (const auto &attribute : input.attributes) {
-        if (Generic::iequals(input.type, "_all")) {
+        if (all) {
             type = "tag";
+            typeFound = true;
             break;
         }
-        if (Generic::iequals(attribute->name, "_type")) {
+        if (keyword(attribute->name) == Keyword::TYPE) {
             type = attributeValueToString(attribute->value);
+            typeFound = true;
             break;
         }
     }
+    if (!typeFound && rule.inheritedType) {
+        type = *rule.inheritedType;
+    }
 
     if (type.empty()) {
-        std::cerr << "(" << name << ")" << " Element " << input.type << " doesn't have a _type, assuming \"Tag\"" << std::endl;
+        diagnostic(name) << "Element " << selector << " doesn't have a _type, assuming \"Tag\"";
     }
 
-    if (Generic::iequals(type, "class")) {
-        result += ".";
-    } else if (Generic::iequals(type, "id")) {
-        result += "#";
-    } else if (!Generic::iequals(type, "tag")) {
-        std::cerr << "(" << name << ")" << " Unknown _type: " << type << ", assuming \"Tag\"" << std::endl;
+    switch (keyword(type)) {
+        case Keyword::CLASS:
+            result += ".";
+            break;
+        case Keyword::ID:
+            result += "#";
+            break;
+        case Keyword::TAG:
+            break;
+        default:
+            diagnostic(name) << "Unknown _type: " << type << ", assuming \"Tag\"";
     }
 
-    if (Generic::iequals(input.type, "_all")) {
-        result += "*";
-        if (!minify) {
-            result += " ";
-        }
-        result += "{";
+    if (all) {
+        result += '*';
+        format.space(result);
+        result += '{';
     } else {
-        result += input.type + (!minify ? " " : "") + "{" + (!minify ? "\n" : "");
+        result += selector;
+        format.space(result);
+        result += '{';
+        format.lineEnd(result);
     }
+    size_t firstNested = pending.size();
     for (const auto &list : input.lists) {
-        if (Generic::iequals(list->type, "_pseudoelements")) {
-            for (const auto &element : list->elements) {
-                Config::ConfigElement *newElement = element->element;
-                newElement->type = input.type + "::" + newElement->type;
-                afterMain += elementHelper(*newElement, name, templates, minify, indent);
-            }
-        }
-        if (Generic::iequals(list->type, "_pseudoclasses")) {
-            for (const auto &element : list->elements) {
-                Config::ConfigElement *newElement = element->element;
-                newElement->type = input.type + ":" + newElement->type;
-                auto newAttribute = Config::ConfigElementAttribute("_type", type);
-                newElement->attributes.push_back(&newAttribute);
-                afterMain += elementHelper(*newElement, name, templates, minify, indent);
-            }
-        }
-        if (Generic::iequals(list->type, "_templates")) {
-            for (const auto &element : list->elements) {
-                if (!Generic::iequals(element->element->type, "Template")) {
-                    std::cerr << "(" << name << ")" << " Expected Template, got " << element->element->type << std::endl;
-                    continue;
+        switch (keyword(list->type)) {
+            case Keyword::PSEUDO_ELEMENTS:
+                for (const auto &element : list->elements) {
+                    const Config::ConfigElement *newElement = element->element;
+                    pending.push_back({newElement, selector + "::" + newElement->type, std::nullopt});
                 }
-                std::string templateName;
-                for (const auto &attribute : element->element->attributes) {
-                    if (Generic::iequals(attribute->name, "Name")) {
-                        templateName = attributeValueToString(attribute->value);
-                    } else {
-                        std::cerr << "(" << name << ")" << " Expected Name, got " << attribute->name << std::endl;
-                    }
+                break;
+            case Keyword::PSEUDO_CLASSES:
+                for (const auto &element : list->elements) {
+                    const Config::ConfigElement *newElement = element->element;
+                    pending.push_back({newElement, selector + ":" + newElement->type, type});
                 }
-                if (!templates.contains(templateName)) {
-                    std::cerr << "(" << name << ")" << " Template " << element->element->attributes[0]->name << " not found" << std::endl;
-                    continue;
+                break;
+            case Keyword::TEMPLATES:
+                for (const auto &element : list->elements) {
+                    if (keyword(element->element->type) != Keyword::TEMPLATE) {
+                        diagnostic(name) << "Expected Template, got " << element->element->type;
+                        continue;
+                    }
+                    std::string templateName;
+                    for (const auto &attribute : element->element->attributes) {
+                        if (Generic::iequals(attribute->name, "Name")) {
+                            templateName = attributeValueToString(attribute->value);
+                        } else {
+                            diagnostic(name) << "Expected Name, got " << attribute->name;
+                        }
+                    }
+                    if (!templates.contains(templateName)) {
+                        diagnostic(name) << "Template " << element->element->attributes[0]->name << " not found";
+                        continue;
+                    }
+                    result += templates.at(templateName);
+                    instantiations++;
                 }
-                result += templates.at(templateName);
-            }
+                break;
+            default:
+                break;
         }
     }
-    result += elementInsideHelper(input, minify, indent);
-    result += "}";
-    if (!minify) {
-        result += "\n";
-    }
-    result += afterMain;
-    return result;
+    result += elementInsideHelper(input, format);
+    result += '}';
+    format.lineEnd(result);
+    // popped in the order they appear
+    std::reverse(pending.begin() + static_cast<ptrdiff_t>(firstNested), pending.end());
 }
 
-std::string parseCSS(const Config::ConfigRoot &input, bool minify, size_t indent) {
-    std::map<std::string, std::string> templates;
-    std::string result;
+}
+
+template<typename Format>
+void collectTemplates(const Config::ConfigRoot &input, std::map<std::string, std::string> &templates, Format format) {
     for (const auto &list : input.lists) {
-        if (Generic::iequals(list->type, "_templates")) {
+        Keyword listType = keyword(list->type);
+        if (listType == Keyword::TEMPLATES) {
             for (const auto &element : list->elements) {
-                templates.emplace(element->element->type, elementInsideHelper(*element->element, minify, indent));
+                templates.emplace(element->element->type, elementInsideHelper(*element->element, format));
             }
             continue;
         }
-        std::cerr << "(" << input.name << ")" << " Unknown list type: " << list->type << std::endl;
-    }
-    for (const auto &element : input.elements) {
-        result += elementHelper(*element, input.name, templates, minify, indent);
+        if (listType == Keyword::IMPORTS) {
+            continue;
+        }
+        diagnostic(input.name) << "Unknown list type: " << list->type;
     }
-    return result;
 }
+
+std::string parseCSS(const Config::ConfigRoot &input, bool minify, size_t indent, const std::vector<const Config::ConfigRoot*> &imports, size_t *instantiations) {
+    // instantiated once per formatting mode, the emitters don't check for it themselves
+    return withFormatting(minify, indent, [&](auto format) {
+        std::map<std::string, std::string> templates;
+        size_t count = 0;
+        std::string result;
+        collectTemplates(input, templates, format);
+        // templates of the file itself take precedence over imported ones
+        for (const auto &library : imports) {
+            collectTemplates(*library, templates, format);
+        }
+        std::vector<PendingRule> pending;
+        for (const auto &element : input.elements) {
+            pending.push_back({element, element->type, std::nullopt});
+            while (!pending.empty()) {
+                PendingRule rule = std::move(pending.back());
+                pending.pop_back();
+                elementHelper(rule, pending, result, input.name, templates, format, count);
+            }
+        }
+        if (instantiations != nullptr) {
+            *instantiations = count;
+        }
+        return result;
+    });
+}
+
+
+std::string parseCSS(const Config::ConfigRoot &input, bool minify, size_t indent) {
+    return parseCSS(input, minify, indent, {});
+}
\ No newline at end of file
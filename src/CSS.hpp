@@ -9,3 +9,6 @@
 using namespace PLCL;
 
 std::string parseCSS(const Config::ConfigRoot &input, bool minify, size_t indent);
+// imports are the roots of the imported template libraries, in import order
+// the number of template instantiations is stored in instantiations unless it's nullptr
+std::string parseCSS(const Config::ConfigRoot &input, bool minify, size_t indent, const std::vector<const Config::ConfigRoot*> &imports, size_t *instantiations = nullptr);
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+#include "Cache.hpp"
+#include "CMakeInfo.hpp"
+#include "Diagnostics.hpp"
+#include "Hash.hpp"
+#include "InputFile.hpp"
+
+// bump when the format of the cache file changes, or the output the same input compiles to
+static constexpr std::string_view CACHE_HEADER = "PLCLToWeb cache 3";
+
+BuildCache::BuildCache(const Cli &cli) : cli(cli), path(cli.output / FILE_NAME) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        return;
+    }
+    std::string line;
+    if (!std::getline(ifs, line) || line != CACHE_HEADER) {
+        return;
+    }
+    // <file>\t<key>\t<output size>\t<output modified>[\t<dependency>...]
+    while (std::getline(ifs, line)) {
+        std::istringstream stream(line);
+        std::string file;
+        std::string key;
+        std::string size;
+        std::string modified;
+        if (!std::getline(stream, file, '\t') || !std::getline(stream, key, '\t') ||
+            !std::getline(stream, size, '\t') || !std::getline(stream, modified, '\t')) {
+            continue;
+        }
+        Entry entry{};
+        if (std::from_chars(key.data(), key.data() + key.size(), entry.key, 16).ec != std::errc() ||
+            std::from_chars(size.data(), size.data() + size.size(), entry.outputSize).ec != std::errc() ||
+            std::from_chars(modified.data(), modified.data() + modified.size(), entry.outputModified).ec != std::errc()) {
+            continue;
+        }
+        std::string dependency;
+        while (std::getline(stream, dependency, '\t')) {
+            entry.dependencies.emplace_back(dependency);
+        }
+        entries.insert_or_assign(std::filesystem::path(file), std::move(entry));
+    }
+}
+
+std::optional<std::vector<std::filesystem::path>> BuildCache::dependencies(const std::filesystem::path &file) const {
+    std::lock_guard lock(mutex);
+    auto it = entries.find(file);
+    if (it == entries.end()) {
+        return std::nullopt;
+    }
+    return it->second.dependencies;
+}
+
+uint64_t BuildCache::fileHash(const std::filesystem::path &file) {
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(file, error);
+    if (error) {
+        // missing imports still have to change the key once they show up
+        return 0;
+    }
+    {
+        std::lock_guard lock(mutex);
+        auto it = fileHashes.find(file);
+        if (it != fileHashes.end() && it->second.modified == modified) {
+            return it->second.hash;
+        }
+    }
+    std::optional<InputFile> input = InputFile::read(file, cli.watch ? InputFile::Access::Read : InputFile::Access::Map);
+    uint64_t hash = input ? hashBytes(input->view()) : hashBytes({});
+    std::lock_guard lock(mutex);
+    fileHashes.insert_or_assign(file, FileHash{modified, hash});
+    return hash;
+}
+
+uint64_t BuildCache::key(std::string_view content, const std::vector<std::filesystem::path> &dependencies) {
+    uint64_t key = hashBytes(content);
+    for (const auto &dependency : dependencies) {
+        key = hashBytes(dependency.string(), key);
+        key = hashCombine(key, fileHash(dependency));
+    }
+    key = hashCombine(key, VERSION_MAJOR);
+    key = hashCombine(key, VERSION_MINOR);
+    key = hashCombine(key, VERSION_PATCH);
+    key = hashCombine(key, cli.dontMinify);
+    key = hashCombine(key, cli.indent);
+    key = hashCombine(key, cli.emitCpp);
+    return key;
+}
+
+bool BuildCache::upToDate(const std::filesystem::path &file, uint64_t key, const std::filesystem::path &output) const {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(output, error);
+    if (error) {
+        return false;
+    }
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(output, error);
+    if (error) {
+        return false;
+    }
+    std::lock_guard lock(mutex);
+    auto it = entries.find(file);
+    return it != entries.end() && it->second.key == key && it->second.outputSize == size &&
+           it->second.outputModified == modified.time_since_epoch().count();
+}
+
+void BuildCache::store(const std::filesystem::path &file, uint64_t key, std::vector<std::filesystem::path> dependencies, const std::filesystem::path &output) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(output, error);
+    std::filesystem::file_time_type modified;
+    if (!error) {
+        modified = std::filesystem::last_write_time(output, error);
+    }
+    std::lock_guard lock(mutex);
+    if (error) {
+        entries.erase(file);
+        return;
+    }
+    entries.insert_or_assign(file, Entry{key, size, static_cast<int64_t>(modified.time_since_epoch().count()), std::move(dependencies)});
+}
+
+void BuildCache::erase(const std::filesystem::path &file) {
+    std::lock_guard lock(mutex);
+    entries.erase(file);
+}
+
+bool BuildCache::save() const {
+    std::lock_guard lock(mutex);
+    std::ofstream ofs(path, std::ios::trunc);
+    if (!ofs) {
+        diagnostics() << "Failed to write the build cache " << path.string() << std::endl;
+        return false;
+    }
+    ofs << CACHE_HEADER << '\n';
+    for (const auto &[file, entry] : entries) {
+        ofs << file.string() << '\t' << std::hex << entry.key << std::dec << '\t' << entry.outputSize << '\t' << entry.outputModified;
+        for (const auto &dependency : entry.dependencies) {
+            ofs << '\t' << dependency.string();
+        }
+        ofs << '\n';
+    }
+    return static_cast<bool>(ofs);
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Cli.hpp"
+#include "Generic.hpp"
+
+// On-disk cache in the output directory remembering the key every output was built with.
+// The key covers the input, everything it imports, the version and the output settings,
+// so a file whose key didn't change since the last run doesn't have to be compiled again.
+// The output's size and modification time are remembered too, an output that was replaced
+// or truncated since isn't up to date whatever the key says.
+class BuildCache {
+public:
+    static constexpr std::string_view FILE_NAME = ".plcltoweb-cache";
+
+    explicit BuildCache(const Cli &cli);
+
+    // the imports recorded for the file on the last build, transitively
+    [[nodiscard]] std::optional<std::vector<std::filesystem::path>> dependencies(const std::filesystem::path &file) const;
+    [[nodiscard]] uint64_t key(std::string_view content, const std::vector<std::filesystem::path> &dependencies);
+    [[nodiscard]] bool upToDate(const std::filesystem::path &file, uint64_t key, const std::filesystem::path &output) const;
+    // after the output was written
+    void store(const std::filesystem::path &file, uint64_t key, std::vector<std::filesystem::path> dependencies, const std::filesystem::path &output);
+    // after a failed build, the file is compiled again next time
+    void erase(const std::filesystem::path &file);
+    bool save() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uintmax_t outputSize;
+        // ticks of std::filesystem::file_time_type
+        int64_t outputModified;
+        std::vector<std::filesystem::path> dependencies;
+    };
+    struct FileHash {
+        std::filesystem::file_time_type modified;
+        uint64_t hash;
+    };
+
+    // hash of an imported file, remembered as long as it isn't modified
+    uint64_t fileHash(const std::filesystem::path &file);
+
+    const Cli &cli;
+    std::filesystem::path path;
+    mutable std::mutex mutex;
+    std::unordered_map<std::filesystem::path, Entry, PathHash> entries;
+    std::unordered_map<std::filesystem::path, FileHash, PathHash> fileHashes;
+};
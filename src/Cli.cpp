@@ -5,6 +5,7 @@
 
 #include "Cli.hpp"
 #include "CMakeInfo.hpp"
+#include "ThreadPool.hpp"
 
 Cli::Cli(int argc, char *argv[]) {
     if (argc == 0) {
@@ -31,6 +32,37 @@ Cli::Cli(int argc, char *argv[]) {
                 this->dontMinify = true;
             } else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--watch") == 0) {
                 this->watch = true;
+            } else if (strcmp(argv[i], "--no-cache") == 0) {
+                this->noCache = true;
+            } else if (strcmp(argv[i], "--fsync") == 0) {
+                this->fsync = true;
+            } else if (strcmp(argv[i], "--serve") == 0) {
+                if (i + 1 < argc) {
+                    this->serve = std::filesystem::absolute(argv[++i]).lexically_normal();
+                } else {
+                    std::cerr << "Expected socket path after --serve" << std::endl;
+                    std::exit(1);
+                }
+            } else if (strcmp(argv[i], "--emit-cpp") == 0) {
+                this->emitCpp = true;
+            } else if (strcmp(argv[i], "--fragment-cache") == 0) {
+                this->fragmentCache = true;
+            } else if (strcmp(argv[i], "--stats") == 0) {
+                this->stats = true;
+            } else if (strcmp(argv[i], "--stats-json") == 0) {
+                if (i + 1 < argc) {
+                    this->statsJson = argv[++i];
+                } else {
+                    std::cerr << "Expected output file after --stats-json" << std::endl;
+                    std::exit(1);
+                }
+            } else if (strcmp(argv[i], "--trace") == 0) {
+                if (i + 1 < argc) {
+                    this->trace = argv[++i];
+                } else {
+                    std::cerr << "Expected output file after --trace" << std::endl;
+                    std::exit(1);
+                }
             } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--indent") == 0) {
                 if (i + 1 < argc) {
                     if (std::isdigit(argv[++i][0])) {
@@ -43,13 +75,55 @@ Cli::Cli(int argc, char *argv[]) {
                     std::cerr << "Expected indent after --indent" << std::endl;
                     std::exit(1);
                 }
+            } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+                if (i + 1 < argc) {
+                    if (std::isdigit(argv[++i][0])) {
+                        this->jobs = std::stoul(argv[i]);
+                        if (this->jobs == 0) {
+                            this->jobs = ThreadPool::defaultThreadCount();
+                        }
+                    } else {
+                        std::cerr << "Expected positive number after --jobs" << std::endl;
+                        std::exit(1);
+                    }
+                } else {
+                    std::cerr << "Expected job count after --jobs" << std::endl;
+                    std::exit(1);
+                }
+            } else if (strcmp(argv[i], "--render-threads") == 0) {
+                if (i + 1 < argc) {
+                    if (std::isdigit(argv[++i][0])) {
+                        this->renderThreads = std::stoul(argv[i]);
+                        if (this->renderThreads == 0) {
+                            this->renderThreads = ThreadPool::defaultThreadCount();
+                        }
+                    } else {
+                        std::cerr << "Expected positive number after --render-threads" << std::endl;
+                        std::exit(1);
+                    }
+                } else {
+                    std::cerr << "Expected thread count after --render-threads" << std::endl;
+                    std::exit(1);
+                }
+            } else if (strcmp(argv[i], "--debounce") == 0) {
+                if (i + 1 < argc) {
+                    if (std::isdigit(argv[++i][0])) {
+                        this->debounce = std::stoul(argv[i]);
+                    } else {
+                        std::cerr << "Expected positive number after --debounce" << std::endl;
+                        std::exit(1);
+                    }
+                } else {
+                    std::cerr << "Expected milliseconds after --debounce" << std::endl;
+                    std::exit(1);
+                }
             }
             else {
                 this->files.emplace_back(std::filesystem::absolute(argv[i]).lexically_normal());
             }
         }
     }
-    if (this->files.empty()) {
+    if (this->files.empty() && this->serve.empty()) {
         this->help = true;
     }
     if (this->output.empty()) {
@@ -64,8 +138,19 @@ void Cli::printHelp() const {
     "  -o, --output <path>  Output directory\n"
     "  -v, --version  Display version information\n"
     "  -w, --watch  Watch files for changes\n"
+    "    --debounce <ms>  Wait for <ms> without changes before recompiling, defaults to 100\n"
+    "  --serve <socket>  Keep running and compile the requests sent to the Unix domain socket\n"
+    "  -j, --jobs <count>  Compile files on <count> threads, 0 uses every core, defaults to 1\n"
+    "  --render-threads <count>  Split large P(L)CLHTML documents across <count> threads, 0 uses every core, defaults to 1\n"
+    "  --no-cache  Compile every file, even if the build cache says it's up to date\n"
+    "  --fsync  Flush every written output to disk before it replaces the previous one\n"
     "  --dont-minify  Don't minify the output\n"
     "    -i, --indent <size>  Indent size (in spaces), defaults to 4\n"
+    "  --emit-cpp  Write a C++ header with render functions instead of HTML\n"
+    "  --fragment-cache  Render identical template instantiations once, --stats shows how often that paid off\n"
+    "  --stats  Print the time, size and allocation statistics of every compiled file\n"
+    "    --stats-json <path>  Write them as JSON to <path>, with or without --stats\n"
+    "  --trace <path>  Write a Chrome trace of the compile pipeline to <path>, for Perfetto\n"
     "Supported file extensions:\n"
     "  .p(l)clhtml  HTML files\n"
     "  .p(l)clcss  CSS files"
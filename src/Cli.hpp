@@ -9,11 +9,22 @@
 struct Cli {
     std::vector<std::filesystem::path> files;
     std::filesystem::path output;
+    std::filesystem::path serve;
     bool help = false;
     bool version = false;
     bool dontMinify = false;
     bool watch = false;
+    bool noCache = false;
+    bool fsync = false;
+    bool emitCpp = false;
+    bool fragmentCache = false;
+    bool stats = false;
+    std::filesystem::path statsJson;
+    std::filesystem::path trace;
     size_t indent = 4;
+    size_t jobs = 1;
+    size_t renderThreads = 1;
+    size_t debounce = 100; // in milliseconds
     std::string executableName;
 
     Cli(int argc, char *argv[]);
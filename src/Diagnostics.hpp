@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libPLCLToWeb.hpp>
+
+// Diagnostics go to std::cerr unless the current thread redirected them somewhere else.
+// Parallel builds use that to buffer every file's messages and print them in input order.
+inline std::ostream *&diagnosticsStream() {
+    thread_local std::ostream *stream = nullptr;
+    return stream;
+}
+
+inline std::ostream &diagnostics() {
+    std::ostream *stream = diagnosticsStream();
+    return stream != nullptr ? *stream : std::cerr;
+}
+
+struct DiagnosticsRedirect {
+    std::ostream *previous;
+
+    explicit DiagnosticsRedirect(std::ostream &stream) : previous(diagnosticsStream()) {
+        diagnosticsStream() = &stream;
+    }
+    DiagnosticsRedirect(const DiagnosticsRedirect &) = delete;
+    DiagnosticsRedirect &operator=(const DiagnosticsRedirect &) = delete;
+    ~DiagnosticsRedirect() {
+        diagnosticsStream() = previous;
+    }
+};
+
+// The compiler reports Diagnostic values instead of text, compiles collect them per thread and hand
+// them out as they are. Without a collector they're printed the way the command line tool does.
+inline std::vector<PLCLToWeb::Diagnostic> *&diagnosticsCollector() {
+    thread_local std::vector<PLCLToWeb::Diagnostic> *collector = nullptr;
+    return collector;
+}
+
+inline void report(PLCLToWeb::Diagnostic diagnostic) {
+    std::vector<PLCLToWeb::Diagnostic> *collector = diagnosticsCollector();
+    if (collector != nullptr) {
+        collector->push_back(std::move(diagnostic));
+    } else {
+        diagnostics() << diagnostic << std::endl;
+    }
+}
+
+struct DiagnosticsCollect {
+    std::vector<PLCLToWeb::Diagnostic> *previous;
+
+    explicit DiagnosticsCollect(std::vector<PLCLToWeb::Diagnostic> &collector) : previous(diagnosticsCollector()) {
+        diagnosticsCollector() = &collector;
+    }
+    DiagnosticsCollect(const DiagnosticsCollect &) = delete;
+    DiagnosticsCollect &operator=(const DiagnosticsCollect &) = delete;
+    ~DiagnosticsCollect() {
+        diagnosticsCollector() = previous;
+    }
+};
+
+// the message is built with <<, the diagnostic is reported at the end of the statement
+class DiagnosticBuilder {
+public:
+    explicit DiagnosticBuilder(std::string_view source) : source(source) {}
+    DiagnosticBuilder(const DiagnosticBuilder &) = delete;
+    DiagnosticBuilder &operator=(const DiagnosticBuilder &) = delete;
+    ~DiagnosticBuilder() {
+        report({std::move(source), std::move(message).str()});
+    }
+
+    template<typename T>
+    DiagnosticBuilder &operator<<(const T &value) {
+        message << value;
+        return *this;
+    }
+
+private:
+    std::string source;
+    std::ostringstream message;
+};
+
+// source is the file, template or element the message is about, empty if it doesn't name one
+inline DiagnosticBuilder diagnostic(std::string_view source = {}) {
+    return DiagnosticBuilder(source);
+}
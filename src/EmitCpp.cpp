@@ -0,0 +1,485 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include "EmitCpp.hpp"
+#include "CMakeInfo.hpp"
+#include "Diagnostics.hpp"
+
+namespace {
+
+// the generated counterpart of escapeHTML, scalar since the header has to stand on its own
+constexpr std::string_view APPEND_ESCAPED = R"(template<typename Sink>
+void appendEscaped(Sink &sink, std::string_view text, bool attribute) {
+    std::size_t clean = 0;
+    for (std::size_t i = 0; i < text.size(); i++) {
+        std::string_view entity;
+        switch (text[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = attribute ? "&quot;" : ""; break;
+            default: break;
+        }
+        if (!entity.empty()) {
+            sink.append(text.substr(clean, i - clean));
+            sink.append(entity);
+            clean = i + 1;
+        }
+    }
+    sink.append(text.substr(clean));
+}
+)";
+
+enum class VariableType {
+    LITERAL,
+    LITERAL_ARRAY,
+};
+
+// a template variable or loop value and the C++ name it has in the generated code
+struct Symbol {
+    std::string name;
+    std::string identifier;
+    VariableType type;
+};
+
+struct Function {
+    PlanBlock body;
+    std::string identifier;
+    std::vector<Symbol> parameters;
+};
+
+// anything that can't be part of an identifier becomes an underscore
+std::string identifier(std::string_view name) {
+    std::string result;
+    result.reserve(name.size());
+    for (char character : name) {
+        result += std::isalnum(static_cast<unsigned char>(character)) ? character : '_';
+    }
+    return result;
+}
+
+// a variable's name in the generated code, names starting with a digit get a prefix to stay valid
+std::string variableIdentifier(std::string_view name) {
+    std::string result = identifier(name);
+    if (result.empty() || std::isdigit(static_cast<unsigned char>(result.front()))) {
+        result.insert(0, "v_");
+    }
+    return result;
+}
+
+// the namespace the header is generated into, named after the file. Leading underscores are dropped,
+// runs of them collapsed and names starting with a digit get a prefix, so stems like 404 or _draft
+// don't make it invalid or reserved, the _html suffix keeps it apart from keywords
+std::string namespaceName(std::string_view stem) {
+    std::string result;
+    for (char character : identifier(stem)) {
+        if (character != '_' || (!result.empty() && result.back() != '_')) {
+            result += character;
+        }
+    }
+    if (result.empty()) {
+        result = "page_";
+    } else if (std::isdigit(static_cast<unsigned char>(result.front()))) {
+        result.insert(0, "page_");
+    }
+    if (result.back() != '_') {
+        result += '_';
+    }
+    return result + "html";
+}
+
+// quoted C++ string literal, split after every newline if splitLines is set
+std::string stringLiteral(std::string_view text, bool splitLines = false) {
+    static constexpr char DIGITS[] = "01234567";
+    std::string result = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        auto character = static_cast<unsigned char>(text[i]);
+        switch (character) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\t': result += "\\t"; break;
+            case '\r': result += "\\r"; break;
+            case '\n':
+                result += "\\n";
+                if (splitLines && i + 1 < text.size()) {
+                    result += "\"\n    \"";
+                }
+                break;
+            default:
+                if (character < 0x20 || character == 0x7f) {
+                    // octal escapes end after 3 digits, hex ones would swallow the following characters
+                    result += '\\';
+                    result += DIGITS[character >> 6];
+                    result += DIGITS[(character >> 3) & 7];
+                    result += DIGITS[character & 7];
+                } else {
+                    result += static_cast<char>(character);
+                }
+        }
+    }
+    result += '"';
+    return result;
+}
+
+// literals with a null byte would be cut short by the string_view constructor
+std::string viewLiteral(std::string_view text) {
+    if (text.find('\0') == std::string_view::npos) {
+        return stringLiteral(text);
+    }
+    return "std::string_view{" + stringLiteral(text) + ", " + std::to_string(text.size()) + "}";
+}
+
+// variables a block uses that none of its loops introduce, in order of first use
+void collectParameters(const RenderPlan &plan, PlanBlock block, std::vector<std::string> &shadowed, std::vector<Symbol> &parameters) {
+    auto use = [&](const std::string &name, VariableType type) {
+        if (std::ranges::find(shadowed, name) != shadowed.end()) {
+            return;
+        }
+        auto it = std::ranges::find(parameters, name, &Symbol::name);
+        if (it == parameters.end()) {
+            parameters.push_back({name, variableIdentifier(name) + '_', type});
+        } else if (type == VariableType::LITERAL_ARRAY) {
+            it->type = type;
+        }
+    };
+    for (size_t i = block.begin; i < block.end; i++) {
+        const PlanInstruction &instruction = plan.instructions[i];
+        switch (instruction.op) {
+            case PlanOp::BINDING:
+                use(plan.bindings[instruction.index].source, VariableType::LITERAL);
+                break;
+            case PlanOp::ATTRIBUTES:
+                for (const auto &binding : plan.attributes[instruction.index].bindings) {
+                    use(binding.source, VariableType::LITERAL);
+                }
+                break;
+            case PlanOp::LOOP: {
+                const PlanLoop &loop = plan.loops[instruction.index];
+                use(loop.source, VariableType::LITERAL_ARRAY);
+                shadowed.push_back(loop.source);
+                collectParameters(plan, loop.body, shadowed, parameters);
+                shadowed.pop_back();
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+const Symbol *findSymbol(const std::vector<Symbol> &symbols, std::string_view name) {
+    auto it = std::ranges::find(symbols.rbegin(), symbols.rend(), name, &Symbol::name);
+    return it == symbols.rend() ? nullptr : &*it;
+}
+
+class CppEmitter {
+public:
+    explicit CppEmitter(const RenderPlan &plan);
+    void write(const std::filesystem::path &file, OutputSink &output);
+
+private:
+    void blockHelper(PlanBlock block, std::vector<Symbol> &symbols, size_t depth);
+    void attributesHelper(const PlanAttributes &attributes, const std::vector<Symbol> &symbols, size_t depth);
+    void callHelper(const PlanCall &call, size_t depth);
+    std::optional<std::string> argument(const PlanCall &call, const Symbol &parameter);
+    std::string pageVariable(const PlanCall &call, const Symbol &parameter, std::string value);
+    std::string signature(const Function &function) const;
+
+    // static text is merged until the next expression, then written as a single constant
+    void text(std::string_view text) {
+        pending += text;
+    }
+    void expression(std::string_view expression, size_t depth);
+    // the value of the expression with the characters that are special in the context escaped
+    void escaped(std::string_view expression, bool attribute, size_t depth);
+    void flush(size_t depth);
+
+    const RenderPlan &plan;
+    // keyed by the first instruction of the template body
+    std::map<size_t, Function> functions;
+    std::vector<std::string> constants;
+    std::unordered_map<std::string, size_t> constantIds;
+    // the arrays the members of Variables point to by default
+    std::vector<std::string> arrays;
+    // the members of Variables, one per variable of every template the page instantiates itself
+    std::string members;
+    // instantiations of every template by the page so far, they number the members
+    std::unordered_map<std::string, size_t> pageCalls;
+    std::string pending;
+    std::string code;
+    // set while the page itself is written, its calls take their values from Variables
+    bool inPage = false;
+    // appendEscaped is only written if it's used
+    bool escapes = false;
+};
+
+CppEmitter::CppEmitter(const RenderPlan &plan) : plan(plan) {
+    std::vector<std::string> identifiers = {"render"};
+    for (const auto &call : plan.calls) {
+        if (functions.contains(call.body.begin)) {
+            continue;
+        }
+        // the same template instantiated at different depths has a body per indentation
+        Function function{call.body, "render" + identifier(call.name), {}};
+        for (size_t i = 1; std::ranges::find(identifiers, function.identifier) != identifiers.end(); i++) {
+            function.identifier = "render" + identifier(call.name) + '_' + std::to_string(i);
+        }
+        identifiers.push_back(function.identifier);
+        std::vector<std::string> shadowed;
+        collectParameters(plan, call.body, shadowed, function.parameters);
+        functions.emplace(call.body.begin, std::move(function));
+    }
+}
+
+void CppEmitter::expression(std::string_view expression, size_t depth) {
+    flush(depth);
+    code.append(depth * 4, ' ').append("sink.append(").append(expression).append(");\n");
+}
+
+void CppEmitter::escaped(std::string_view expression, bool attribute, size_t depth) {
+    flush(depth);
+    escapes = true;
+    code.append(depth * 4, ' ').append("detail::appendEscaped(sink, ").append(expression).append(attribute ? ", true);\n" : ", false);\n");
+}
+
+void CppEmitter::flush(size_t depth) {
+    if (pending.empty()) {
+        return;
+    }
+    auto [it, inserted] = constantIds.try_emplace(pending, constants.size());
+    if (inserted) {
+        constants.push_back(pending);
+    }
+    code.append(depth * 4, ' ').append("sink.append(detail::TEXT_").append(std::to_string(it->second)).append(");\n");
+    pending.clear();
+}
+
+void CppEmitter::blockHelper(PlanBlock block, std::vector<Symbol> &symbols, size_t depth) {
+    for (size_t i = block.begin; i < block.end; i++) {
+        const PlanInstruction &instruction = plan.instructions[i];
+        switch (instruction.op) {
+            case PlanOp::TEXT:
+                text(std::string_view(plan.text).substr(instruction.index, instruction.length));
+                break;
+            case PlanOp::BINDING: {
+                const PlanBinding &binding = plan.bindings[instruction.index];
+                const Symbol *symbol = findSymbol(symbols, binding.source);
+                if (symbol == nullptr) {
+                    diagnostic(binding.name) << "Binding variable " << binding.source << " not found in variables";
+                } else if (symbol->type != VariableType::LITERAL) {
+                    diagnostic(binding.name) << "Binding variable " << binding.source << " is not a Literal";
+                } else if (binding.raw) {
+                    expression(symbol->identifier, depth);
+                } else {
+                    escaped(symbol->identifier, false, depth);
+                }
+                break;
+            }
+            case PlanOp::LOOP: {
+                const PlanLoop &loop = plan.loops[instruction.index];
+                const Symbol *symbol = findSymbol(symbols, loop.source);
+                if (symbol == nullptr) {
+                    diagnostic(loop.name) << "Binding variable " << loop.source << " not found in variables";
+                    break;
+                }
+                if (symbol->type != VariableType::LITERAL_ARRAY) {
+                    diagnostic(loop.name) << "Binding variable " << loop.source << " is not a LiteralArray";
+                    break;
+                }
+                flush(depth);
+                std::string value = variableIdentifier(loop.source) + '_' + std::to_string(depth);
+                code.append(depth * 4, ' ').append("for (std::string_view ").append(value).append(" : ").append(symbol->identifier).append(") {\n");
+                symbols.push_back({loop.source, value, VariableType::LITERAL});
+                blockHelper(loop.body, symbols, depth + 1);
+                symbols.pop_back();
+                flush(depth + 1);
+                code.append(depth * 4, ' ').append("}\n");
+                break;
+            }
+            case PlanOp::CALL:
+                callHelper(plan.calls[instruction.index], depth);
+                break;
+            case PlanOp::ATTRIBUTES:
+                attributesHelper(plan.attributes[instruction.index], symbols, depth);
+                break;
+        }
+    }
+}
+
+void CppEmitter::attributesHelper(const PlanAttributes &attributes, const std::vector<Symbol> &symbols, size_t depth) {
+    // every binding of a generated function has a value, so which one wins is known up front
+    std::vector<std::optional<std::string>> overrides(attributes.rendered.size());
+    std::vector<std::tuple<uint32_t, std::string_view, std::string>> added;
+    for (const auto &binding : attributes.bindings) {
+        const Symbol *symbol = findSymbol(symbols, binding.source);
+        if (symbol == nullptr) {
+            diagnostic(attributes.name) << "Binding variable " << binding.source << " not found in variables";
+            continue;
+        }
+        std::string value = symbol->identifier;
+        if (symbol->type == VariableType::LITERAL_ARRAY) {
+            diagnostic(attributes.name) << "_BindingLoop not used for a LiteralArray. Getting the first element";
+            value = "(" + value + ".empty() ? std::string_view() : " + value + ".front())";
+        }
+        if (binding.target < overrides.size()) {
+            overrides[binding.target] = std::move(value);
+            continue;
+        }
+        auto it = std::ranges::find(added, binding.target, [](const auto &entry) { return std::get<0>(entry); });
+        if (it != added.end()) {
+            std::get<2>(*it) = std::move(value);
+        } else {
+            added.emplace_back(binding.target, binding.targetName, std::move(value));
+        }
+    }
+    for (size_t i = 0; i < overrides.size(); i++) {
+        if (overrides[i]) {
+            text(" ");
+            text(attributes.names[i]);
+            text("=\"");
+            escaped(*overrides[i], true, depth);
+            text("\"");
+        } else {
+            text(attributes.rendered[i]);
+        }
+    }
+    for (const auto &[slot, name, value] : added) {
+        text(" ");
+        text(name);
+        text("=\"");
+        escaped(value, true, depth);
+        text("\"");
+    }
+}
+
+// nullopt if the call has no usable value for the parameter
+std::optional<std::string> CppEmitter::argument(const PlanCall &call, const Symbol &parameter) {
+    const VariableValue *value = call.variables->find(parameter.name);
+    bool literal = parameter.type == VariableType::LITERAL;
+    if (value == nullptr) {
+        diagnostic(call.name) << "Binding variable " << parameter.name << " not found in variables";
+        return std::nullopt;
+    }
+    if (std::holds_alternative<std::string_view>(*value)) {
+        if (literal) {
+            return viewLiteral(std::get<std::string_view>(*value));
+        }
+        diagnostic(call.name) << "Binding variable " << parameter.name << " is not a LiteralArray";
+        return std::nullopt;
+    }
+    if (std::holds_alternative<const LiteralArray*>(*value)) {
+        const LiteralArray &array = *std::get<const LiteralArray*>(*value);
+        if (literal) {
+            diagnostic(call.name) << "_BindingLoop not used for a LiteralArray. Getting the first element";
+            return array.empty() ? "{}" : viewLiteral(array.front());
+        }
+        std::string result = "std::array<std::string_view, " + std::to_string(array.size()) + ">{";
+        for (size_t i = 0; i < array.size(); i++) {
+            result += (i == 0 ? "" : ", ") + viewLiteral(array[i]);
+        }
+        return result + '}';
+    }
+    diagnostic() << "FIXME: ELEMENT";
+    return literal ? std::optional<std::string>("\"FIXME: ELEMENT\"") : std::nullopt;
+}
+
+// adds a member to Variables that defaults to the value and returns the expression reading it
+std::string CppEmitter::pageVariable(const PlanCall &call, const Symbol &parameter, std::string value) {
+    std::string name = variableIdentifier(call.name + '_' + std::to_string(pageCalls[call.name]) + '_' + parameter.name);
+    if (parameter.type == VariableType::LITERAL) {
+        members.append("    std::string_view ").append(name).append(" = ").append(value).append(";\n");
+    } else {
+        // a span takes arrays of any length, the default one lives in detail
+        members.append("    std::span<const std::string_view> ").append(name).append(" = detail::VALUES_").append(std::to_string(arrays.size())).append(";\n");
+        arrays.push_back(std::move(value));
+    }
+    return "variables." + name;
+}
+
+void CppEmitter::callHelper(const PlanCall &call, size_t depth) {
+    const Function &function = functions.at(call.body.begin);
+    std::string arguments = "sink";
+    for (const auto &parameter : function.parameters) {
+        std::optional<std::string> value = argument(call, parameter);
+        if (!value) {
+            arguments += ", {}";
+        } else if (inPage) {
+            arguments += ", " + pageVariable(call, parameter, std::move(*value));
+        } else {
+            arguments += ", " + *value;
+        }
+    }
+    if (inPage) {
+        pageCalls[call.name]++;
+    }
+    flush(depth);
+    code.append(depth * 4, ' ').append(function.identifier).append("(").append(arguments).append(");\n");
+}
+
+std::string CppEmitter::signature(const Function &function) const {
+    std::string result = "template<typename Sink>\nvoid " + function.identifier + "(Sink &sink";
+    for (const auto &parameter : function.parameters) {
+        result += parameter.type == VariableType::LITERAL ? ", std::string_view " : ", std::span<const std::string_view> ";
+        result += parameter.identifier;
+    }
+    return result + ')';
+}
+
+void CppEmitter::write(const std::filesystem::path &file, OutputSink &output) {
+    for (const auto &[begin, function] : functions) {
+        code += signature(function) + " {\n";
+        std::vector<Symbol> symbols = function.parameters;
+        blockHelper(function.body, symbols, 1);
+        flush(1);
+        code += "}\n\n";
+    }
+    code += "template<typename Sink>\nvoid render(Sink &sink, const Variables &variables = {}) {\n";
+    std::vector<Symbol> symbols;
+    inPage = true;
+    blockHelper(plan.root, symbols, 1);
+    flush(1);
+    inPage = false;
+    if (members.empty()) {
+        code += "    (void) variables;\n";
+    }
+    code += "}\n";
+
+    output << "// Generated by PLCLToWeb " << std::to_string(VERSION_MAJOR) << '.' << std::to_string(VERSION_MINOR) << '.'
+           << std::to_string(VERSION_PATCH) << " from " << file.filename().string() << ", don't edit\n\n"
+           << "#pragma once\n\n"
+           << "#include <array>\n"
+           << "#include <span>\n"
+           << "#include <string_view>\n\n"
+           << "namespace " << namespaceName(file.stem().string()) << " {\n\n";
+    if (!constants.empty() || !arrays.empty() || escapes) {
+        output << "namespace detail {\n";
+        for (size_t i = 0; i < constants.size(); i++) {
+            output << "inline constexpr std::string_view TEXT_" << std::to_string(i) << "{"
+                   << stringLiteral(constants[i], true) << ", " << std::to_string(constants[i].size()) << "};\n";
+        }
+        for (size_t i = 0; i < arrays.size(); i++) {
+            output << "inline constexpr auto VALUES_" << std::to_string(i) << " = " << arrays[i] << ";\n";
+        }
+        if (escapes) {
+            output << (constants.empty() && arrays.empty() ? "" : "\n") << APPEND_ESCAPED;
+        }
+        output << "}\n\n";
+    }
+    // the values the page passes to the templates it instantiates, named <template>_<instantiation>_<variable>
+    output << "struct Variables {\n" << members << "};\n\n";
+    for (const auto &[begin, function] : functions) {
+        output << signature(function) << ";\n\n";
+    }
+    output << code << "\n}\n";
+}
+
+}
+
+void emitCpp(const RenderPlan &plan, const std::filesystem::path &file, OutputSink &output) {
+    CppEmitter(plan).write(file, output);
+}
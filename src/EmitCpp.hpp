@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+
+#include "RenderPlan.hpp"
+#include "Sink.hpp"
+
+// Writes a compiled P(L)CLHTML document as a C++ header that only depends on the standard library.
+// Every template body becomes a function template taking its variables as std::string_view or
+// std::span<const std::string_view>, render() writes the whole page. The values the page itself passes to
+// its templates are members of a Variables struct that defaults to them, render takes one to replace them.
+// Static markup is baked in as constexpr literals, the sink only needs an append(std::string_view)
+// member, like std::string or OutputSink.
+void emitCpp(const RenderPlan &plan, const std::filesystem::path &file, OutputSink &output);
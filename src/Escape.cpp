@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <bit>
+#include "Escape.hpp"
+
+namespace {
+
+constexpr bool special(char character, EscapeContext context) {
+    return character == '&' || character == '<' || character == '>' || (character == '"' && context == EscapeContext::ATTRIBUTE);
+}
+
+}
+
+size_t cleanPrefix(std::string_view text, EscapeContext context) {
+    size_t i = 0;
+    // the quote is only searched for in attributes, in text it's compared against the ampersand again
+    const char quote = context == EscapeContext::ATTRIBUTE ? '"' : '&';
+#if defined(__AVX2__)
+    const __m256i ampersands = _mm256_set1_epi8('&');
+    const __m256i lessThans = _mm256_set1_epi8('<');
+    const __m256i greaterThans = _mm256_set1_epi8('>');
+    const __m256i quotes = _mm256_set1_epi8(quote);
+    for (; i + 32 <= text.size(); i += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        __m256i found = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, ampersands), _mm256_cmpeq_epi8(bytes, lessThans)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, greaterThans), _mm256_cmpeq_epi8(bytes, quotes)));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(found));
+        if (mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i ampersands = _mm_set1_epi8('&');
+    const __m128i lessThans = _mm_set1_epi8('<');
+    const __m128i greaterThans = _mm_set1_epi8('>');
+    const __m128i quotes = _mm_set1_epi8(quote);
+    for (; i + 16 <= text.size(); i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, ampersands), _mm_cmpeq_epi8(bytes, lessThans)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, greaterThans), _mm_cmpeq_epi8(bytes, quotes)));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(found));
+        if (mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+#else
+    (void) quote;
+#endif
+    for (; i < text.size(); i++) {
+        if (special(text[i], context)) {
+            return i;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <string_view>
+
+// Where escaped text ends up. Attribute values are always written between double quotes.
+enum class EscapeContext {
+    TEXT,      // &, < and >
+    ATTRIBUTE, // the same and "
+};
+
+// length of the prefix of text that can be written as is
+size_t cleanPrefix(std::string_view text, EscapeContext context);
+
+// the entity a character found by cleanPrefix is replaced with
+constexpr std::string_view entity(char character) {
+    switch (character) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        default: return "&quot;";
+    }
+}
+
+// appends text with the characters that are special in the context replaced by entities, clean runs
+// are appended in one piece. Output is a std::string or an OutputSink.
+template<typename Output>
+void escapeHTML(std::string_view text, EscapeContext context, Output &output) {
+    while (!text.empty()) {
+        size_t clean = cleanPrefix(text, context);
+        output.append(text.substr(0, clean));
+        if (clean == text.size()) {
+            return;
+        }
+        output.append(entity(text[clean]));
+        text.remove_prefix(clean + 1);
+    }
+}
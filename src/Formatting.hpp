@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <array>
+#include <string>
+
+// Formatting policies the HTML and CSS emitters are instantiated with. The minified one writes no
+// whitespace without checking for it, the pretty ones take their indentation from a table of spaces.
+
+inline constexpr auto SPACES = [] {
+    std::array<char, 256> spaces{};
+    spaces.fill(' ');
+    return spaces;
+}();
+
+// deeper indentation is appended in table-sized pieces
+inline void appendSpaces(std::string &output, size_t count) {
+    while (count > SPACES.size()) {
+        output.append(SPACES.data(), SPACES.size());
+        count -= SPACES.size();
+    }
+    output.append(SPACES.data(), count);
+}
+
+struct MinifiedFormat {
+    // indentation is never written, so nested elements all share indentation 0
+    static constexpr size_t indent() {
+        return 0;
+    }
+    // a line break followed by the indentation of the next line
+    static void newline(std::string &, size_t) {}
+    // a line break on its own
+    static void lineEnd(std::string &) {}
+    static void indentation(std::string &, size_t) {}
+    // the space before a CSS block and after a property name
+    static void space(std::string &) {}
+};
+
+struct PrettyFormat {
+    static void newline(std::string &output, size_t indentation) {
+        output += '\n';
+        appendSpaces(output, indentation);
+    }
+    static void lineEnd(std::string &output) {
+        output += '\n';
+    }
+    static void indentation(std::string &output, size_t count) {
+        appendSpaces(output, count);
+    }
+    static void space(std::string &output) {
+        output += ' ';
+    }
+};
+
+template<size_t Indent>
+struct FixedIndentFormat : PrettyFormat {
+    static constexpr size_t indent() {
+        return Indent;
+    }
+};
+
+struct RuntimeIndentFormat : PrettyFormat {
+    size_t width;
+
+    [[nodiscard]] size_t indent() const {
+        return width;
+    }
+};
+
+// calls fn with the policy for minify and indent, the default indent gets a specialization of its own
+template<typename F>
+decltype(auto) withFormatting(bool minify, size_t indent, F &&fn) {
+    if (minify) {
+        return fn(MinifiedFormat{});
+    }
+    if (indent == 4) {
+        return fn(FixedIndentFormat<4>{});
+    }
+    return fn(RuntimeIndentFormat{{}, indent});
+}
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <filesystem>
 #include <utility>
 #include <libPLCL.hpp>
 
@@ -19,4 +20,11 @@ inline static std::string attributeValueToString(Generic::ValueType value) {
     } else {
         std::unreachable();
     }
-}
\ No newline at end of file
+}
+
+// std::hash<std::filesystem::path> isn't available everywhere yet
+struct PathHash {
+    size_t operator()(const std::filesystem::path &path) const noexcept {
+        return std::filesystem::hash_value(path);
+    }
+};
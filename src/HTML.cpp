@@ -1,70 +1,192 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <tuple>
 #include <utility>
+#include <variant>
 #include "HTML.hpp"
+#include "RenderPlan.hpp"
+#include "Allocations.hpp"
+#include "Diagnostics.hpp"
+#include "Escape.hpp"
+#include "Formatting.hpp"
 #include "Generic.hpp"
+#include "Hash.hpp"
+#include "Keywords.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
 
-std::string listHelper(const Config::ConfigList& list, const std::string_view& name, const std::map<std::string, const Config::ConfigElement*>& templates, const std::map<std::string, std::shared_ptr<VariableValue>>* variables, bool minify, size_t indent, size_t indentStart);
-
-std::string attributeHelper(const std::vector<Config::ConfigElementAttribute*> &attributes) {
-    std::string result;
-    for (const auto &attribute : attributes) {
-        // ExampleAttributeName -> example-attribute-name
-        std::string newName = attribute->name;
-        for (size_t i = 0; i < newName.size(); i++) {
-            if (isupper(newName[i]) && i != 0) {
-                newName.insert(i, "-");
-                i++;
+const VariableValue *VariableScope::find(std::string_view name) const {
+    for (const VariableScope *scope = this; scope != nullptr; scope = scope->parent) {
+        for (const auto &[variableName, value] : scope->variables) {
+            if (variableName == name) {
+                return &value;
             }
         }
-        std::ranges::transform(newName, newName.begin(), ::tolower);
+    }
+    return nullptr;
+}
 
-        if (std::holds_alternative<std::string>(attribute->value)) {
-            result += " " + newName + "=\"" + std::get<std::string>(attribute->value) + "\"";
-        } else if (std::holds_alternative<int64_t>(attribute->value)) {
-            result += " " + newName + "=" + std::to_string(std::get<int64_t>(attribute->value));
-        } else if (std::holds_alternative<Generic::float64_t>(attribute->value)) {
-            result += " " + newName + "=" + std::to_string(std::get<Generic::float64_t>(attribute->value));
-        } else if (std::holds_alternative<bool>(attribute->value) && std::get<bool>(attribute->value)) {
-            result += " " + newName;
+bool VariableScope::contains(std::string_view name) const {
+    return std::ranges::any_of(variables, [name](const auto &variable) { return variable.first == name; });
+}
+
+VariableValue &VariableScope::add(std::string name, VariableValue value) {
+    return variables.emplace_back(std::move(name), value).second;
+}
+
+std::string_view VariableScope::store(std::string value) {
+    return strings.emplace_back(std::move(value));
+}
+
+const LiteralArray *VariableScope::store(LiteralArray value) {
+    return &arrays.emplace_back(std::move(value));
+}
+
+bool VariableScope::sameVariables(const VariableScope &other) const {
+    return std::ranges::equal(variables, other.variables, [](const auto &a, const auto &b) {
+        if (a.first != b.first || a.second.index() != b.second.index()) {
+            return false;
+        }
+        if (std::holds_alternative<const LiteralArray*>(a.second)) {
+            return *std::get<const LiteralArray*>(a.second) == *std::get<const LiteralArray*>(b.second);
+        }
+        return a.second == b.second;
+    });
+}
+
+uint64_t VariableScope::hash() const {
+    uint64_t result = FNV_OFFSET_BASIS;
+    for (const auto &[name, value] : variables) {
+        result = hashCombine(hashBytes(name, result), value.index());
+        if (std::holds_alternative<std::string_view>(value)) {
+            result = hashBytes(std::get<std::string_view>(value), result);
+        } else if (std::holds_alternative<const LiteralArray*>(value)) {
+            for (const auto &literal : *std::get<const LiteralArray*>(value)) {
+                result = hashCombine(hashBytes(literal, result), literal.size());
+            }
+        } else {
+            result = hashCombine(result, reinterpret_cast<uintptr_t>(std::get<const Config::ConfigElement*>(value)));
         }
     }
     return result;
 }
 
-// is called when listHelper encounters an element whose type is in the templates map
-std::string templateHelper(const Config::ConfigElement* element, const std::map<std::string, const Config::ConfigElement*> templates, bool minify, size_t indent, size_t indentStart) {
-    std::string result;
-    std::map<std::string, std::shared_ptr<VariableValue>> variables;
+size_t TemplateRegistry::NameHash::operator()(std::string_view name) const {
+    return hashBytesCaseInsensitive(name);
+}
+
+bool TemplateRegistry::NameEquals::operator()(std::string_view a, std::string_view b) const {
+    return std::ranges::equal(a, b, [](char x, char y) { return asciiLower(x) == asciiLower(y); });
+}
+
+bool TemplateRegistry::add(std::string_view name, const Config::ConfigElement *element) {
+    auto [it, inserted] = ids.try_emplace(std::string(name), static_cast<TemplateId>(elements.size()));
+    if (!inserted) {
+        return false;
+    }
+    names.push_back(it->first);
+    elements.push_back(element);
+    return true;
+}
+
+void TemplateRegistry::addLibrary(const TemplateRegistry &library) {
+    libraries.push_back(&library);
+}
+
+TemplateId TemplateRegistry::find(std::string_view name) const {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    size_t offset = elements.size();
+    for (const TemplateRegistry *library : libraries) {
+        TemplateId id = library->find(name);
+        if (id != NOT_FOUND) {
+            return static_cast<TemplateId>(offset + id);
+        }
+        offset += library->size();
+    }
+    return NOT_FOUND;
+}
+
+const Config::ConfigElement *TemplateRegistry::at(TemplateId id) const {
+    size_t index = id;
+    if (index < elements.size()) {
+        return elements[index];
+    }
+    index -= elements.size();
+    for (const TemplateRegistry *library : libraries) {
+        if (index < library->size()) {
+            return library->at(static_cast<TemplateId>(index));
+        }
+        index -= library->size();
+    }
+    return nullptr;
+}
+
+size_t TemplateRegistry::size() const {
+    size_t result = elements.size();
+    for (const TemplateRegistry *library : libraries) {
+        result += library->size();
+    }
+    return result;
+}
+
+// renders an attribute with its own value, including the leading space
+void attributeHelper(const Config::ConfigElementAttribute *attribute, std::string &output) {
+    std::string_view newName = attributeName(attribute->name);
+    if (std::holds_alternative<std::string>(attribute->value)) {
+        output.append(" ").append(newName).append("=\"");
+        escapeHTML(std::get<std::string>(attribute->value), EscapeContext::ATTRIBUTE, output);
+        output.append("\"");
+    } else if (std::holds_alternative<int64_t>(attribute->value)) {
+        output.append(" ").append(newName).append("=").append(std::to_string(std::get<int64_t>(attribute->value)));
+    } else if (std::holds_alternative<Generic::float64_t>(attribute->value)) {
+        output.append(" ").append(newName).append("=").append(std::to_string(std::get<Generic::float64_t>(attribute->value)));
+    } else if (std::holds_alternative<bool>(attribute->value) && std::get<bool>(attribute->value)) {
+        output.append(" ").append(newName);
+    }
+}
+
+// builds the variables of a template instantiation from its attributes, its _VariableValues and the template's defaults
+void templateVariables(const Config::ConfigElement *element, const Config::ConfigElement *templateElement, VariableScope &variables) {
     for (const auto &attribute : element->attributes) {
         std::string lowercaseName = attribute->name;
-        std::ranges::transform(lowercaseName, lowercaseName.begin(), ::tolower);
+        std::ranges::transform(lowercaseName, lowercaseName.begin(), asciiLower);
         if (variables.contains(lowercaseName)) {
-            std::cerr << "(" << element->type << ")" << " Variable " << lowercaseName << " already exists" << std::endl;
+            diagnostic(element->type) << "Variable " << lowercaseName << " already exists";
             continue;
         }
         if (std::holds_alternative<std::string>(attribute->value)) {
-            variables.emplace(lowercaseName, std::make_shared<VariableValue>(std::get<std::string>(attribute->value)));
+            variables.add(lowercaseName, std::string_view(std::get<std::string>(attribute->value)));
         } else if (std::holds_alternative<int64_t>(attribute->value)) {
-            variables.emplace(lowercaseName, std::make_shared<VariableValue>(std::to_string(std::get<int64_t>(attribute->value))));
+            variables.add(lowercaseName, variables.store(std::to_string(std::get<int64_t>(attribute->value))));
         } else if (std::holds_alternative<Generic::float64_t>(attribute->value)) {
-            variables.emplace(lowercaseName, std::make_shared<VariableValue>(std::to_string(std::get<Generic::float64_t>(attribute->value))));
+            variables.add(lowercaseName, variables.store(std::to_string(std::get<Generic::float64_t>(attribute->value))));
         } else if (std::holds_alternative<bool>(attribute->value)) {
-            variables.emplace(lowercaseName, std::make_shared<VariableValue>(std::to_string(std::get<bool>(attribute->value))));
+            variables.add(lowercaseName, variables.store(std::to_string(std::get<bool>(attribute->value))));
         }
     }
     for (const auto &list : element->lists) {
-        if (Generic::iequals(list->type, "variablevalues")) {
+        if (keyword(list->type) == Keyword::VARIABLE_VALUES) {
             for (const auto &listElement : list->elements) {
                 const Config::ConfigElement *child_element = listElement->element;
                 if (child_element == nullptr) {
-                    std::cerr << "(" << element->type << ")" << " Unexpected null element in the _VariableValues list" << std::endl;
+                    diagnostic(element->type) << "Unexpected null element in the _VariableValues list";
                     continue;
                 }
-                if (!Generic::iequals(child_element->type, "VariableValue")) {
-                    std::cerr << "(" << child_element->type << ")" << " Expected VariableValue, got " << element->type << std::endl;
+                if (keyword(child_element->type) != Keyword::VARIABLE_VALUE) {
+                    diagnostic(child_element->type) << "Expected VariableValue, got " << element->type;
                     continue;
                 }
                 std::string variableName;
@@ -73,24 +195,29 @@ std::string templateHelper(const Config::ConfigElement* element, const std::map<
                     if (Generic::iequals(attribute->name, "Name")) {
                         variableName = attributeValueToString(attribute->value);
                     } else if (Generic::iequals(attribute->name, "Type")) {
-                        if (Generic::iequals(attributeValueToString(attribute->value), "Literal")) {
-                            type = LITERAL;
-                        } else if (Generic::iequals(attributeValueToString(attribute->value), "LiteralArray")) {
-                            type = LITERAL_ARRAY;
-                        } else if (Generic::iequals(attributeValueToString(attribute->value), "Element")) {
-                            type = ELEMENT;
-                        } else {
-                            std::cerr << "(" << child_element->type << ")" << " Expected Literal, LiteralArray or Element, got " << attributeValueToString(attribute->value) << std::endl;
+                        std::string typeName = attributeValueToString(attribute->value);
+                        switch (keyword(typeName)) {
+                            case Keyword::LITERAL:
+                                type = LITERAL;
+                                break;
+                            case Keyword::LITERAL_ARRAY:
+                                type = LITERAL_ARRAY;
+                                break;
+                            case Keyword::ELEMENT:
+                                type = ELEMENT;
+                                break;
+                            default:
+                                diagnostic(child_element->type) << "Expected Literal, LiteralArray or Element, got " << typeName;
                         }
                     }
                 }
                 if (variableName.empty()) {
-                    std::cerr << "(" << child_element->type << ")" << " VariableValue elements need to have the \"Name\" attribute" << std::endl;
+                    diagnostic(child_element->type) << "VariableValue elements need to have the \"Name\" attribute";
                     continue;
                 }
-                std::ranges::transform(variableName, variableName.begin(), ::tolower);
+                std::ranges::transform(variableName, variableName.begin(), asciiLower);
                 if (variables.contains(variableName)) {
-                    std::cerr << "(" << child_element->type << ")" << " Variable " << variableName << " already exists" << std::endl;
+                    diagnostic(child_element->type) << "Variable " << variableName << " already exists";
                     continue;
                 }
                 if (type == LITERAL) {
@@ -99,82 +226,81 @@ std::string templateHelper(const Config::ConfigElement* element, const std::map<
                         if (Generic::iequals(attribute->name, "Value")) {
                             value = attributeValueToString(attribute->value);
                         } else {
-                            std::cerr << "(" << child_element->type << ")" << " Expected Value, got " << attribute->name << std::endl;
+                            diagnostic(child_element->type) << "Expected Value, got " << attribute->name;
                         }
                     }
                     if (value.empty()) {
-                        std::cerr << "(" << child_element->type << ")" << " Literal VariableValue elements need to have the \"Value\" attribute" << std::endl;
+                        diagnostic(child_element->type) << "Literal VariableValue elements need to have the \"Value\" attribute";
                         continue;
                     }
-                    variables.emplace(variableName, std::make_shared<VariableValue>(value));
+                    variables.add(variableName, variables.store(std::move(value)));
                 } else if (type == LITERAL_ARRAY) {
                     std::vector<std::string> value;
                     for (const auto &list : child_element->lists) {
-                        if (Generic::iequals(list->type, "Value")) {
+                        if (keyword(list->type) == Keyword::VALUE) {
                             if (list->elements.size() != 1) {
-                                std::cerr << "(" << child_element->type << ")" << " Expected 1 element, got " << list->elements.size() << std::endl;
+                                diagnostic(child_element->type) << "Expected 1 element, got " << list->elements.size();
                                 continue;
                             }
-                            Config::ConfigElement *listElement = list->elements[0]->element;
-                            if (Generic::iequals(listElement->type, "_LiteralList")) {
-                                std::ranges::remove_if(listElement->attributes, [](const Config::ConfigElementAttribute* attribute) {
-                                    std::string name = attribute->name;
-                                    std::ranges::transform(name, name.begin(), ::tolower);
-                                    return !name.starts_with("element");
-                                });
-                                for (auto &attribute : listElement->attributes) {
-                                    attribute->name = attribute->name.substr(7);
-                                }
-                                std::ranges::sort(listElement->attributes, [](const Config::ConfigElementAttribute* a, const Config::ConfigElementAttribute* b) {
-                                    return std::stoi(a->name) < std::stoi(b->name);
-                                });
+                            const Config::ConfigElement *listElement = list->elements[0]->element;
+                            if (keyword(listElement->type) == Keyword::LITERAL_LIST) {
+                                // ElementN attributes, ordered by N
+                                std::vector<std::pair<int, const Config::ConfigElementAttribute*>> elements;
                                 for (const auto &attribute : listElement->attributes) {
-                                    std::string attribute_string = attributeValueToString(attribute->value);
-                                    value.push_back(attribute_string);
+                                    std::string_view attributeName = attribute->name;
+                                    int index;
+                                    if (attributeName.size() <= 7 || keyword(attributeName.substr(0, 7)) != Keyword::ELEMENT ||
+                                        std::from_chars(attributeName.data() + 7, attributeName.data() + attributeName.size(), index).ec != std::errc()) {
+                                        diagnostic(child_element->type) << "Expected ElementN, got " << attribute->name;
+                                        continue;
+                                    }
+                                    elements.emplace_back(index, attribute);
+                                }
+                                std::ranges::stable_sort(elements, {}, &std::pair<int, const Config::ConfigElementAttribute*>::first);
+                                value.reserve(elements.size());
+                                for (const auto &[index, attribute] : elements) {
+                                    value.push_back(attributeValueToString(attribute->value));
                                 }
                             } else {
-                                std::cerr << "(" << child_element->type << ")" << " Expected _LiteralList, got " << listElement->type << std::endl;
+                                diagnostic(child_element->type) << "Expected _LiteralList, got " << listElement->type;
                             }
                         } else {
-                            std::cerr << "(" << child_element->type << ")" << " Expected Value, got " << list->type << std::endl;
+                            diagnostic(child_element->type) << "Expected Value, got " << list->type;
                         }
                     }
                     if (value.empty()) {
-                        std::cerr << "(" << child_element->type << ")" << " LiteralArray VariableValue elements need to have the \"Value\" attribute" << std::endl;
+                        diagnostic(child_element->type) << "LiteralArray VariableValue elements need to have the \"Value\" attribute";
                         continue;
                     }
-                    variables.emplace(variableName, std::make_shared<VariableValue>(value));
+                    variables.add(variableName, variables.store(std::move(value)));
                 } else if (type == ELEMENT) {
                     for (const auto &list : child_element->lists) {
-                        if (Generic::iequals(list->type, "Value")) {
+                        if (keyword(list->type) == Keyword::VALUE) {
                             if (list->elements.size() != 1) {
-                                std::cerr << "(" << child_element->type << ")" << " Expected 1 element, got " << list->elements.size() << std::endl;
+                                diagnostic(child_element->type) << "Expected 1 element, got " << list->elements.size();
                                 continue;
                             }
-                            variables.emplace(variableName, std::make_shared<VariableValue>(*list->elements[0]->element));
+                            variables.add(variableName, static_cast<const Config::ConfigElement*>(list->elements[0]->element));
                         } else {
-                            std::cerr << "(" << child_element->type << ")" << " Expected Value, got " << list->type << std::endl;
+                            diagnostic(child_element->type) << "Expected Value, got " << list->type;
                         }
                     }
-                    std::cerr << "(" << child_element->type << ")" << " No Value list found in VariableValue" << std::endl;
+                    diagnostic(child_element->type) << "No Value list found in VariableValue";
                 }
             }
         }
     }
-    std::string lowercaseType = element->type;
-    std::ranges::transform(lowercaseType, lowercaseType.begin(), ::tolower);
-    const Config::ConfigElement *templateElement = templates.at(lowercaseType);
     // have to go over the lists twice for the variables to be available
     for (const auto &list : templateElement->lists) {
-        if (Generic::iequals(list->type, "variables")) {
+        if (keyword(list->type) == Keyword::VARIABLES) {
             for (const auto &listElement : list->elements) {
                 const Config::ConfigElement* child_element = listElement->element;
                 if (child_element == nullptr) {
-                    std::cerr << "(" << element->type << ")" << " Unexpected null element in the _Variables list" << std::endl;
+                    diagnostic(element->type) << "Unexpected null element in the _Variables list";
                     continue;
                 }
-                if (!Generic::iequals(child_element->type, "Variable")) {
-                    std::cerr << "(" << child_element->type << ")" << " Expected Variable, got " << element->type << std::endl;
+                if (keyword(child_element->type) != Keyword::VARIABLE) {
+                    diagnostic(child_element->type) << "Expected Variable, got " << element->type;
                     continue;
                 }
                 std::string variableName;
@@ -183,271 +309,750 @@ std::string templateHelper(const Config::ConfigElement* element, const std::map<
                         variableName = attributeValueToString(attribute->value);
                     } else if (Generic::iequals(attribute->name, "Default")) {
                         if (!variables.contains(variableName)) {
-                            std::ranges::transform(variableName, variableName.begin(), ::tolower);
-                            std::string value = attributeValueToString(attribute->value);
-                            variables.emplace(variableName, std::make_shared<VariableValue>(value));
+                            std::ranges::transform(variableName, variableName.begin(), asciiLower);
+                            if (!variables.contains(variableName)) {
+                                variables.add(variableName, variables.store(attributeValueToString(attribute->value)));
+                            }
                         }
                     } else {
-                        std::cerr << "(" << child_element->type << ")" << " Expected Name, got " << attribute->name << std::endl;
+                        diagnostic(child_element->type) << "Expected Name, got " << attribute->name;
                     }
                 }
             }
         }
     }
-    for (const auto &list : templateElement->lists) {
-        if (Generic::iequals(list->type, "elements")) {
-            result += listHelper(*list, element->type, templates, &variables, minify, indent, indentStart);
+}
+
+namespace {
+
+// checks a Binding element and reads its attributes, the source is lowercased
+bool bindingAttributes(const Config::ConfigElement *element, std::string_view name, std::string &source, std::string &target) {
+    if (element == nullptr) {
+        diagnostic(name) << "Unexpected null element in Bindings";
+        return false;
+    }
+    if (keyword(element->type) != Keyword::BINDING) {
+        diagnostic(name) << "Expected Binding, got " << element->type;
+        return false;
+    }
+    for (const auto &attribute : element->attributes) {
+        if (Generic::iequals(attribute->name, "Source")) {
+            source = attributeValueToString(attribute->value);
+        } else if (Generic::iequals(attribute->name, "Target")) {
+            target = attributeValueToString(attribute->value);
+        } else {
+            diagnostic(name) << "Expected Source or Target, got " << attribute->name;
         }
     }
-
-    return result;
+    if (source.empty() || target.empty()) {
+        diagnostic(name) << "Binding elements need to have the \"Source\" and \"Target\" attributes";
+        return false;
+    }
+    std::ranges::transform(source, source.begin(), asciiLower);
+    return true;
 }
 
-std::string listHelper(const Config::ConfigList& list, const std::string_view& name, const std::map<std::string, const Config::ConfigElement*>& templates, const std::map<std::string, std::shared_ptr<VariableValue>>* variables, bool minify, size_t indent, size_t indentStart) {
-    std::string result;
-    for (const auto &element : list.elements) {
-        if (element->element == nullptr) {
-            std::cerr << "(" << name << ")" << " ConfigListElement doesn't contain a ConfigElement" << std::endl;
-            continue;
-        }
-        Config::ConfigElement *child_element = element->element;
-        if (Generic::iequals(child_element->type, "_text")) {
-            if (!minify) {
-                result += "\n";
-                result += std::string(indentStart, ' ');
+// lists of the document whose small subtrees hold fewer elements are lowered in a row
+constexpr size_t PARALLEL_MIN_ELEMENTS = 4096;
+// subtrees with this many elements are lowered in place and their own lists are split in turn,
+// this many lists deep at most
+constexpr size_t LARGE_SUBTREE_ELEMENTS = 16384;
+constexpr size_t PARALLEL_MAX_DEPTH = 8;
+// runs of small subtrees with fewer elements aren't worth a segment, the caller lowers them
+constexpr size_t SEGMENT_MIN_ELEMENTS = 512;
+// more segments than threads, so subtrees of different sizes even out
+constexpr size_t COMPILE_SEGMENTS_PER_THREAD = 4;
+
+// the element and the elements nested in its lists, up to limit. Walked with a stack of elements, so
+// deep documents don't recurse
+size_t subtreeSize(const Config::ConfigElement *element, size_t limit) {
+    size_t size = 0;
+    std::vector<const Config::ConfigElement*> pending{element};
+    while (!pending.empty() && size < limit) {
+        const Config::ConfigElement *current = pending.back();
+        pending.pop_back();
+        size++;
+        for (const auto &list : current->lists) {
+            for (const auto &listElement : list->elements) {
+                if (listElement->element != nullptr) {
+                    pending.push_back(listElement->element);
+                }
             }
-            if (child_element->attributes.empty() && child_element->lists.empty()) {
-                std::cerr << "(" << name << ")" << " _Text pseudo-elements should have the \"Content\" attribute or the \"Bindings\" list"
-                          << std::endl;
+        }
+    }
+    return size;
+}
+
+// The runs of small sibling subtrees of a list, cut into contiguous segments that the render pool's
+// helpers lower into plans of their own while the caller goes on with the large subtrees in between.
+// The caller splices the segments once it gets to them, compiling the ones nobody claimed yet instead
+// of waiting, so the plan and its diagnostics come out in the order of the document. Helpers that
+// start after everything was claimed return without touching the compiler, which may be gone by then.
+struct ParallelCompile {
+    struct Segment {
+        size_t begin = 0;
+        size_t end = 0;
+        RenderPlan plan{};
+        std::vector<PLCLToWeb::Diagnostic> diagnostics{};
+        std::exception_ptr exception{};
+        bool done = false;
+    };
+
+    std::function<RenderPlan(size_t begin, size_t end)> compile;
+    std::vector<Segment> segments;
+    // by element index, the subtrees lowered in place
+    std::vector<bool> large;
+    // the allocations of every segment count for the thread the compile is for
+    AllocationTracker *tracker = AllocationTracker::active();
+    std::atomic<size_t> next = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // compiles segments until none are left, or just one if once is set, returns false once none are left
+    bool work(bool once) {
+        size_t index;
+        while ((index = next.fetch_add(1)) < segments.size()) {
+            Segment &segment = segments[index];
+            {
+                // the tracker is only safe to use until the segment is done
+                AllocationScope allocations(tracker);
+                TraceSpan span("segment", "compile segment", index);
+                try {
+                    DiagnosticsCollect collect(segment.diagnostics);
+                    segment.plan = compile(segment.begin, segment.end);
+                } catch (...) {
+                    segment.exception = std::current_exception();
+                }
             }
-            if (child_element->attributes.size() > 1) {
-                std::cerr << "(" << name << ")" << " _Text pseudo-elements shouldn't have more than 1 attribute"
-                          << std::endl;
+            {
+                std::lock_guard lock(mutex);
+                segment.done = true;
             }
-            for (const auto &lists : child_element->lists) {
-                if (Generic::iequals(lists->type, "_Bindings")) {
-                    if (variables == nullptr) {
-                        std::cerr << "(" << name << ")" << " Bindings cannot be used outside of a template" << std::endl;
-                        continue;
-                    }
-                    for (const auto &listElement : lists->elements) {
-                        Config::ConfigElement *element = listElement->element;
-                        if (element == nullptr) {
-                            std::cerr << "(" << name << ")" << " Unexpected null element in Bindings" << std::endl;
-                            continue;
-                        }
-                        if (!Generic::iequals(element->type, "Binding")) {
-                            std::cerr << "(" << name << ")" << " Expected Binding, got " << element->type << std::endl;
-                            continue;
-                        }
-                        std::string source;
-                        std::string target;
-                        for (const auto &attribute : element->attributes) {
-                            if (Generic::iequals(attribute->name, "Source")) {
-                                source = attributeValueToString(attribute->value);
-                            } else if (Generic::iequals(attribute->name, "Target")) {
-                                target = attributeValueToString(attribute->value);
-                            } else {
-                                std::cerr << "(" << name << ")" << " Expected Source or Target, got " << attribute->name << std::endl;
-                            }
-                        }
-                        if (source.empty() || target.empty()) {
-                            std::cerr << "(" << name << ")" << " Binding elements need to have the \"Source\" and \"Target\" attributes" << std::endl;
-                            continue;
-                        }
-                        if (!Generic::iequals(target, "content")) {
-                            std::cerr << "(" << name << ")" << " Binding elements for the \"_Text\" element should have the \"Target\" attribute set to \"Content\"" << std::endl;
-                            continue;
-                        }
-                        std::ranges::transform(source, source.begin(), ::tolower);
-                        if (variables->contains(source)) {
-                            VariableValue* value = variables->at(source).get();
-                            if (value == nullptr) {
-                                std::cerr << "(" << name << ")" << " Unexpected null value" << std::endl;
-                                continue;
-                            }
-                            if (std::holds_alternative<std::string>(*value)) {
-                                result += std::get<std::string>(*value);
-                            } else {
-                                std::cerr << "(" << name << ")" << " Binding variable " << source << " is not a Literal" << std::endl;
-                            }
-                        } else {
-                            std::cerr << "(" << name << ")" << " Binding variable " << source << " not found in variables" << std::endl;
-                        }
-                    }
-                }
+            finished.notify_all();
+            if (once) {
+                return true;
             }
-            for (const auto &attribute: child_element->attributes) {
-                if (Generic::iequals(attribute->name, "Content")) {
-                    result += attributeValueToString(attribute->value);
-                }
+        }
+        return false;
+    }
+
+    // the finished segment's plan, its diagnostics are reported again on the calling thread, so they
+    // end up where its own ones do
+    RenderPlan take(Segment &segment) {
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&segment] { return segment.done; });
+        }
+        for (auto &diagnostic : segment.diagnostics) {
+            report(std::move(diagnostic));
+        }
+        if (segment.exception) {
+            std::rethrow_exception(segment.exception);
+        }
+        return std::move(segment.plan);
+    }
+
+    [[nodiscard]] bool claimed(const Segment &segment) const {
+        return next.load() > static_cast<size_t>(&segment - segments.data());
+    }
+
+    // stops handing out segments and waits for the claimed ones, so nothing uses the compiler afterwards
+    void cancel() {
+        size_t claimed = std::min(next.exchange(segments.size()), segments.size());
+        std::unique_lock lock(mutex);
+        for (size_t i = 0; i < claimed; i++) {
+            finished.wait(lock, [&segment = segments[i]] { return segment.done; });
+        }
+    }
+};
+
+// Lowers a document and the templates it instantiates into a RenderPlan. Everything that doesn't
+// depend on variable values, diagnostics included, is handled here once instead of on every render.
+// Nested lists are walked with an explicit stack of tasks instead of recursion, so the nesting depth
+// of a document is only bounded by the heap. Whitespace comes from the Format policy, so the compiler
+// is instantiated once per formatting mode instead of checking for it on every element.
+template<typename Format>
+class PlanCompiler {
+public:
+    // with more than one thread, large lists of the document are lowered in parallel
+    PlanCompiler(RenderPlan &plan, const TemplateRegistry &templates, Format format, size_t threads = 1)
+        : plan(plan), templates(templates), format(format), threads(threads) {}
+    PlanCompiler(const PlanCompiler &) = delete;
+    PlanCompiler &operator=(const PlanCompiler &) = delete;
+    // segments still being compiled use the compiler and the document, a failed compile waits for them
+    ~PlanCompiler() {
+        for (Task &task : tasks) {
+            if (auto *list = std::get_if<ListTask>(&task); list != nullptr && list->parallel) {
+                list->parallel->cancel();
             }
-        } else if (Generic::iequals(child_element->type, "_BindingLoop")) {
-            if (variables == nullptr) {
-                std::cerr << "(" << name << ")" << " _BindingLoops cannot be used outside of a template" << std::endl;
-                continue;
+        }
+    }
+
+    // compiles everything emitted by fn into a block of its own
+    template<typename F>
+    PlanBlock block(F &&fn) {
+        beginBlock();
+        fn();
+        return endBlock();
+    }
+
+    // static text of the current block, merged with its neighbours
+    std::string &text() {
+        return builders.back().text;
+    }
+
+    void newline(size_t indentStart) {
+        format.newline(text(), indentStart);
+    }
+
+    void lineEnd() {
+        format.lineEnd(text());
+    }
+
+    [[nodiscard]] size_t indent() const {
+        return format.indent();
+    }
+
+    // compiles the list and everything nested in it
+    void listHelper(const Config::ConfigList &list, std::string_view name, bool inTemplate, size_t indentStart);
+
+private:
+    struct Builder {
+        std::vector<PlanInstruction> instructions;
+        std::string text;
+    };
+
+    // the elements [next, end) of a list, next is the position to continue at once the nested lists
+    // are done. Lists of the document with split levels left may be lowered in parallel, parallel
+    // holds their segments then and segment is the next one to splice
+    struct ListTask {
+        const Config::ConfigList *list;
+        size_t next;
+        size_t end;
+        std::string_view name;
+        bool inTemplate;
+        size_t indentStart;
+        size_t split = 0;
+        std::shared_ptr<ParallelCompile> parallel{};
+        size_t segment = 0;
+    };
+    // writes the closing tag once the element's lists are compiled
+    struct CloseTask {
+        std::string lowercaseType;
+        bool hasChildren;
+        size_t indentStart;
+    };
+    // emits the _BindingLoop once its body is compiled
+    struct LoopTask {
+        std::string source;
+        std::string_view name;
+    };
+    // emits the template instantiation once its body is compiled
+    struct TemplateTask {
+        const Config::ConfigElement *element;
+        std::unique_ptr<VariableScope> variables;
+        std::tuple<TemplateId, size_t, std::string> key;
+        TraceSpan span;
+    };
+    typedef std::variant<ListTask, CloseTask, LoopTask, TemplateTask> Task;
+
+    void beginBlock() {
+        builders.emplace_back();
+    }
+
+    PlanBlock endBlock() {
+        flush();
+        Builder builder = std::move(builders.back());
+        builders.pop_back();
+        PlanBlock block{plan.instructions.size(), plan.instructions.size() + builder.instructions.size()};
+        plan.instructions.insert(plan.instructions.end(), builder.instructions.begin(), builder.instructions.end());
+        return block;
+    }
+
+    void flush() {
+        Builder &current = builders.back();
+        if (current.text.empty()) {
+            return;
+        }
+        // runs longer than a length can hold are split, instructions stay 16 bytes
+        for (size_t offset = 0; offset < current.text.size(); offset += UINT32_MAX) {
+            size_t length = std::min<size_t>(current.text.size() - offset, UINT32_MAX);
+            current.instructions.push_back({PlanOp::TEXT, static_cast<uint32_t>(length), plan.text.size() + offset});
+        }
+        plan.text += current.text;
+        current.text.clear();
+    }
+
+    void emit(PlanOp op, size_t index) {
+        flush();
+        builders.back().instructions.push_back({op, 0, index});
+    }
+
+    // pushes the matching lists in reverse, so they're compiled in order
+    template<typename P>
+    void pushLists(const Config::ConfigElement *element, P &&predicate, std::string_view name, bool inTemplate, size_t indentStart) {
+        for (auto it = element->lists.rbegin(); it != element->lists.rend(); ++it) {
+            if (predicate(**it)) {
+                tasks.emplace_back(ListTask{*it, 0, (*it)->elements.size(), name, inTemplate, indentStart, element == splitElement ? splitLevels : 0});
             }
-            std::string source;
-            for (const auto &attribute : child_element->attributes) {
-                if (Generic::iequals(attribute->name, "Source")) {
-                    source = attributeValueToString(attribute->value);
+        }
+    }
+
+    // runs the task and everything it pushes
+    void run(ListTask task);
+    void step();
+    // starts lowering the task's small subtrees in parallel if they're worth it
+    void splitList(ListTask &task);
+    // splices the segment starting at the task's position, returns false if there's none
+    bool spliceSegment(ListTask &task);
+    // merges a plan compiled from a segment of the current block into the plan, after what's there
+    void splice(RenderPlan &segment);
+    // raw for _RawHTML, whose content and bound values aren't escaped
+    void textHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart, bool raw);
+    void loopHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart);
+    void elementHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart);
+    void templateHelper(const Config::ConfigElement *element, TemplateId templateId, size_t indentStart);
+    void closeElement(const CloseTask &task);
+    void finishLoop(LoopTask &task);
+    void finishTemplate(TemplateTask &task);
+    void callHelper(const Config::ConfigElement *element, std::unique_ptr<VariableScope> variables, const PlanBlock &body);
+
+    RenderPlan &plan;
+    const TemplateRegistry &templates;
+    Format format;
+    size_t threads;
+    // the large subtree being lowered in place and the split levels its lists get
+    const Config::ConfigElement *splitElement = nullptr;
+    size_t splitLevels = 0;
+    std::vector<Builder> builders;
+    std::vector<Task> tasks;
+    // template bodies only depend on the template, the indentation and the instantiating name
+    std::map<std::tuple<TemplateId, size_t, std::string>, PlanBlock> bodies;
+    // calls by the hash of their body and variables
+    std::unordered_map<uint64_t, std::vector<size_t>> calls;
+    // templates whose bodies are being compiled, to catch templates instantiating themselves
+    std::vector<TemplateId> compiling;
+};
+
+bool isElementsList(const Config::ConfigList &list) {
+    return keyword(list.type) == Keyword::ELEMENTS;
+}
+
+template<typename Format>
+void PlanCompiler<Format>::listHelper(const Config::ConfigList &list, std::string_view name, bool inTemplate, size_t indentStart) {
+    run(ListTask{&list, 0, list.elements.size(), name, inTemplate, indentStart, inTemplate ? 0 : PARALLEL_MAX_DEPTH});
+}
+
+template<typename Format>
+void PlanCompiler<Format>::run(ListTask task) {
+    size_t base = tasks.size();
+    tasks.emplace_back(std::move(task));
+    while (tasks.size() > base) {
+        step();
+    }
+}
+
+template<typename Format>
+void PlanCompiler<Format>::step() {
+    if (auto *task = std::get_if<ListTask>(&tasks.back())) {
+        if (task->split != 0 && task->next == 0) {
+            splitList(*task);
+        }
+        if (task->parallel && spliceSegment(*task)) {
+            return;
+        }
+        if (task->next == task->end) {
+            tasks.pop_back();
+            return;
+        }
+        size_t index = task->next++;
+        const auto &element = task->list->elements[index];
+        // copied, the helpers push tasks of their own
+        std::string_view name = task->name;
+        bool inTemplate = task->inTemplate;
+        size_t indentStart = task->indentStart;
+        if (element->element == nullptr) {
+            diagnostic(name) << "ConfigListElement doesn't contain a ConfigElement";
+            return;
+        }
+        const Config::ConfigElement *child_element = element->element;
+        bool large = task->parallel && task->parallel->large[index];
+        splitElement = large ? child_element : nullptr;
+        splitLevels = large ? task->split - 1 : 0;
+        switch (keyword(child_element->type)) {
+            case Keyword::TEXT:
+                textHelper(child_element, name, inTemplate, indentStart, false);
+                break;
+            case Keyword::RAW_HTML:
+                textHelper(child_element, name, inTemplate, indentStart, true);
+                break;
+            case Keyword::BINDING_LOOP:
+                loopHelper(child_element, name, inTemplate, indentStart);
+                break;
+            default: {
+                TemplateId templateId = templates.find(child_element->type);
+                if (templateId != TemplateRegistry::NOT_FOUND) {
+                    templateHelper(child_element, templateId, indentStart);
                 } else {
-                    std::cerr << "(" << name << ")" << " Expected Source, got " << attribute->name << std::endl;
+                    elementHelper(child_element, name, inTemplate, indentStart);
                 }
             }
-            if (source.empty()) {
-                std::cerr << "(" << name << ")" << " _BindingLoop elements need to have the \"Source\" attribute" << std::endl;
-                continue;
-            }
-            std::ranges::transform(source, source.begin(), ::tolower);
-            if (!variables->contains(source)) {
-                std::cerr << "(" << name << ")" << " Binding variable " << source << " not found in variables" << std::endl;
-                continue;
-            }
-            VariableValue* value = variables->at(source).get();
-            if (value == nullptr) {
-                std::cerr << "(" << name << ")" << " Unexpected null value" << std::endl;
-                continue;
+        }
+        return;
+    }
+    Task task = std::move(tasks.back());
+    tasks.pop_back();
+    if (auto *close = std::get_if<CloseTask>(&task)) {
+        closeElement(*close);
+    } else if (auto *loop = std::get_if<LoopTask>(&task)) {
+        finishLoop(*loop);
+    } else {
+        finishTemplate(std::get<TemplateTask>(task));
+    }
+}
+
+template<typename Format>
+void PlanCompiler<Format>::splitList(ListTask &task) {
+    if (threads <= 1 || task.inTemplate) {
+        return;
+    }
+    const auto &elements = task.list->elements;
+    std::vector<size_t> sizes(elements.size());
+    std::vector<bool> large(elements.size());
+    bool anyLarge = false;
+    size_t small = 0;
+    for (size_t i = 0; i < elements.size(); i++) {
+        sizes[i] = elements[i]->element != nullptr ? subtreeSize(elements[i]->element, LARGE_SUBTREE_ELEMENTS) : 1;
+        large[i] = sizes[i] == LARGE_SUBTREE_ELEMENTS;
+        anyLarge = anyLarge || large[i];
+        small += large[i] ? 0 : sizes[i];
+    }
+    auto state = std::make_shared<ParallelCompile>();
+    if (small >= PARALLEL_MIN_ELEMENTS) {
+        size_t target = std::max(small / (threads * COMPILE_SEGMENTS_PER_THREAD), SEGMENT_MIN_ELEMENTS);
+        size_t begin = 0;
+        size_t run = 0;
+        for (size_t i = 0; i < elements.size(); i++) {
+            run += large[i] ? 0 : sizes[i];
+            if (large[i] || i + 1 == elements.size() || run >= target) {
+                size_t end = large[i] ? i : i + 1;
+                if (run >= SEGMENT_MIN_ELEMENTS) {
+                    ParallelCompile::Segment &segment = state->segments.emplace_back();
+                    segment.begin = begin;
+                    segment.end = end;
+                }
+                begin = i + 1;
+                run = 0;
             }
-            if (!std::holds_alternative<LiteralArray>(*value)) {
-                std::cerr << "(" << name << ")" << " Binding variable " << source << " is not a LiteralArray" << std::endl;
+        }
+    }
+    if (state->segments.empty() && !anyLarge) {
+        return;
+    }
+    state->large = std::move(large);
+    // every segment starts with nothing pending, its text joins the current block's when spliced
+    state->compile = [this, list = task.list, name = task.name, indentStart = task.indentStart](size_t begin, size_t end) {
+        RenderPlan segment;
+        PlanCompiler compiler(segment, templates, format);
+        segment.root = compiler.block([&] {
+            compiler.run(ListTask{list, begin, end, name, false, indentStart});
+        });
+        return segment;
+    };
+    task.parallel = state;
+    for (size_t i = 1; i < threads && i <= state->segments.size(); i++) {
+        renderPool().submit([state] { state->work(false); });
+    }
+}
+
+template<typename Format>
+bool PlanCompiler<Format>::spliceSegment(ListTask &task) {
+    ParallelCompile &parallel = *task.parallel;
+    if (task.segment == parallel.segments.size() || parallel.segments[task.segment].begin != task.next) {
+        return false;
+    }
+    ParallelCompile::Segment &segment = parallel.segments[task.segment++];
+    // the caller compiles too, so a busy pool only makes it slower, it can't deadlock
+    while (!parallel.claimed(segment) && parallel.work(true)) {
+    }
+    RenderPlan plan = parallel.take(segment);
+    splice(plan);
+    task.next = segment.end;
+    return true;
+}
+
+template<typename Format>
+void PlanCompiler<Format>::splice(RenderPlan &segment) {
+    size_t instructions = plan.instructions.size();
+    size_t bindings = plan.bindings.size();
+    size_t loops = plan.loops.size();
+    size_t calls = plan.calls.size();
+    size_t attributes = plan.attributes.size();
+    auto rebase = [&](PlanInstruction instruction) {
+        switch (instruction.op) {
+            case PlanOp::TEXT:
+                break;
+            case PlanOp::BINDING:
+                instruction.index += bindings;
+                break;
+            case PlanOp::LOOP:
+                instruction.index += loops;
+                break;
+            case PlanOp::CALL:
+                instruction.index += calls;
+                break;
+            case PlanOp::ATTRIBUTES:
+                instruction.index += attributes;
+                break;
+        }
+        return instruction;
+    };
+    // the root block is finished last, everything before it are the bodies of loops and calls
+    for (size_t i = 0; i < segment.root.begin; i++) {
+        PlanInstruction instruction = rebase(segment.instructions[i]);
+        if (instruction.op == PlanOp::TEXT) {
+            instruction.index = plan.text.size();
+            plan.text.append(segment.text, segment.instructions[i].index, instruction.length);
+        }
+        plan.instructions.push_back(instruction);
+    }
+    for (PlanLoop &loop : segment.loops) {
+        loop.body = {loop.body.begin + instructions, loop.body.end + instructions};
+        plan.loops.push_back(std::move(loop));
+    }
+    for (PlanCall &call : segment.calls) {
+        call.body = {call.body.begin + instructions, call.body.end + instructions};
+        plan.calls.push_back(std::move(call));
+    }
+    std::ranges::move(segment.bindings, std::back_inserter(plan.bindings));
+    std::ranges::move(segment.attributes, std::back_inserter(plan.attributes));
+    std::ranges::move(segment.scopes, std::back_inserter(plan.scopes));
+    plan.instantiations += segment.instantiations;
+    // the root's text is merged with its neighbours, like it would be compiled in place
+    for (size_t i = segment.root.begin; i < segment.root.end; i++) {
+        const PlanInstruction &instruction = segment.instructions[i];
+        if (instruction.op == PlanOp::TEXT) {
+            text().append(segment.text, instruction.index, instruction.length);
+        } else {
+            PlanInstruction rebased = rebase(instruction);
+            emit(rebased.op, rebased.index);
+        }
+    }
+}
+
+template<typename Format>
+void PlanCompiler<Format>::textHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart, bool raw) {
+    newline(indentStart);
+    if (element->attributes.empty() && element->lists.empty()) {
+        diagnostic(name) << "_Text pseudo-elements should have the \"Content\" attribute or the \"Bindings\" list";
+    }
+    if (element->attributes.size() > 1) {
+        diagnostic(name) << "_Text pseudo-elements shouldn't have more than 1 attribute";
+    }
+    for (const auto &lists : element->lists) {
+        if (keyword(lists->type) == Keyword::BINDINGS) {
+            if (!inTemplate) {
+                diagnostic(name) << "Bindings cannot be used outside of a template";
                 continue;
             }
-            LiteralArray arr = std::get<LiteralArray>(*value);
-            std::map<std::string, std::shared_ptr<VariableValue>> newVariables = *variables;
-            for (const auto& literal : arr) {
-                std::erase_if(newVariables, [source](const std::pair<std::string, std::shared_ptr<VariableValue>>& element) {
-                    return element.first == source;
-                });
-                newVariables.emplace(source, std::make_shared<VariableValue>(literal));
-                for (const auto &list : child_element->lists) {
-                    if (Generic::iequals(list->type, "elements")) {
-                        result += listHelper(*list, name, templates, &newVariables, minify, indent, indentStart);
-                    }
+            for (const auto &listElement : lists->elements) {
+                std::string source;
+                std::string target;
+                if (!bindingAttributes(listElement->element, name, source, target)) {
+                    continue;
                 }
+                if (!Generic::iequals(target, "content")) {
+                    diagnostic(name) << "Binding elements for the \"_Text\" element should have the \"Target\" attribute set to \"Content\"";
+                    continue;
+                }
+                plan.bindings.push_back({std::move(source), std::string(name), raw});
+                emit(PlanOp::BINDING, plan.bindings.size() - 1);
             }
-        } else {
-            for (const auto &attribute : child_element->attributes) { // FIXME: what was this even for
-            }
-            std::string lowercaseType = child_element->type;
-            std::ranges::transform(lowercaseType, lowercaseType.begin(), ::tolower);
-            if (!minify && !templates.contains(lowercaseType)) {
-                result += "\n";
-                result += std::string(indentStart, ' ');
+        }
+    }
+    for (const auto &attribute : element->attributes) {
+        if (Generic::iequals(attribute->name, "Content")) {
+            if (raw) {
+                text() += attributeValueToString(attribute->value);
+            } else {
+                escapeHTML(attributeValueToString(attribute->value), EscapeContext::TEXT, text());
             }
-            if (templates.contains(lowercaseType)) {
-                result += templateHelper(child_element, templates, minify, indent, indentStart);
+        }
+    }
+}
+
+template<typename Format>
+void PlanCompiler<Format>::loopHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart) {
+    if (!inTemplate) {
+        diagnostic(name) << "_BindingLoops cannot be used outside of a template";
+        return;
+    }
+    std::string source;
+    for (const auto &attribute : element->attributes) {
+        if (Generic::iequals(attribute->name, "Source")) {
+            source = attributeValueToString(attribute->value);
+        } else {
+            diagnostic(name) << "Expected Source, got " << attribute->name;
+        }
+    }
+    if (source.empty()) {
+        diagnostic(name) << "_BindingLoop elements need to have the \"Source\" attribute";
+        return;
+    }
+    std::ranges::transform(source, source.begin(), asciiLower);
+    beginBlock();
+    tasks.emplace_back(LoopTask{std::move(source), name});
+    pushLists(element, isElementsList, name, true, indentStart);
+}
+
+template<typename Format>
+void PlanCompiler<Format>::finishLoop(LoopTask &task) {
+    PlanBlock body = endBlock();
+    plan.loops.push_back({std::move(task.source), std::string(task.name), body});
+    emit(PlanOp::LOOP, plan.loops.size() - 1);
+}
+
+template<typename Format>
+void PlanCompiler<Format>::elementHelper(const Config::ConfigElement *element, std::string_view name, bool inTemplate, size_t indentStart) {
+    newline(indentStart);
+    std::string lowercaseType = element->type;
+    std::ranges::transform(lowercaseType, lowercaseType.begin(), asciiLower);
+    PlanAttributes attributes{std::string(name), {}, {}, {}};
+    // targets of the bindings that add attributes, the position is the slot past the own attributes
+    std::vector<std::string> addedTargets;
+    for (const auto &innerList : element->lists) {
+        if (keyword(innerList->type) == Keyword::BINDINGS) {
+            if (!inTemplate) {
+                diagnostic(name) << "Bindings cannot be used outside of a template";
                 continue;
             }
-            for (const auto &innerList : child_element->lists) {
-                if (Generic::iequals(innerList->type, "_Bindings")) {
-                    if (variables == nullptr) {
-                        std::cerr << "(" << name << ")" << " Bindings cannot be used outside of a template" << std::endl;
-                        continue;
-                    }
-                    for (const auto &listElement : innerList->elements) {
-                        if (!Generic::iequals(listElement->element->type, "Binding")) {
-                            std::cerr << "(" << name << ")" << " Expected Binding, got " << listElement->element->type << std::endl;
-                            continue;
-                        }
-                        std::string source;
-                        std::string target;
-                        for (const auto &attribute : listElement->element->attributes) {
-                            if (Generic::iequals(attribute->name, "Source")) {
-                                source = attributeValueToString(attribute->value);
-                            } else if (Generic::iequals(attribute->name, "Target")) {
-                                target = attributeValueToString(attribute->value);
-                            } else {
-                                std::cerr << "(" << name << ")" << " Expected Source or Target, got " << attribute->name << std::endl;
-                            }
-                        }
-                        if (source.empty() || target.empty()) {
-                            std::cerr << "(" << name << ")" << " Binding elements need to have the \"Source\" and \"Target\" attributes" << std::endl;
-                            continue;
-                        }
-                        std::ranges::transform(source, source.begin(), ::tolower);
-                        if (variables->contains(source)) {
-                            VariableValue *value = variables->at(source).get();
-                            if (value == nullptr) {
-                                std::cerr << "(" << name << ")" << " Unexpected null value" << std::endl;
-                                continue;
-                            }
-                            std::string string_value;
-                            if (std::holds_alternative<std::string>(*value)) {
-                                string_value = std::get<std::string>(*value);
-                            } else if (std::holds_alternative<LiteralArray>(*value)) {
-                                std::cerr << "(" << name << ")" << " _BindingLoop not used for a LiteralArray. Getting the first element" << std::endl;
-                                string_value = std::get<LiteralArray>(*value).at(0);
-                            } else if (std::holds_alternative<Config::ConfigElement>(*value)) {
-                                std::cerr << "FIXME: ELEMENT" << std::endl;
-                                string_value = "FIXME: ELEMENT";
-                                //string_value = listHelper(*value->element.lists[0], name, templates, variables, minify, indent, indentStart);
-                            }
-                            bool found = false;
-                            for (const auto &attribute : child_element->attributes) {
-                                if (Generic::iequals(attribute->name, target)) {
-                                    attribute->value = string_value;
-                                    found = true;
-                                    break;
-                                }
-                            }
-                            if (!found) {
-                                Generic::ValueType value = string_value;
-                                auto* newAttribute = new Config::ConfigElementAttribute(target, value);
-                                child_element->attributes.push_back(newAttribute);
-                            }
-                        } else {
-                            std::cerr << "(" << name << ")" << " Binding variable " << source << " not found in variables" << std::endl;
-                        }
-                    }
+            for (const auto &listElement : innerList->elements) {
+                std::string source;
+                std::string target;
+                if (!bindingAttributes(listElement->element, name, source, target)) {
+                    continue;
                 }
-            }
-            result += "<" + lowercaseType;
-            if (!child_element->attributes.empty())
-                result += attributeHelper(child_element->attributes);
-            result += ">";
-            bool hasChildren = false;
-            if (!child_element->lists.empty()) {
-                for (const auto &innerList : child_element->lists) {
-                    if (!Generic::iequals(innerList->type, "_Bindings")) {
-                        hasChildren = true;
-                        result += listHelper(*innerList, name, templates, variables, minify, indent,
-                                             indentStart + indent);
+                auto own = std::ranges::find_if(element->attributes, [&target](const auto &attribute) { return Generic::iequals(attribute->name, target); });
+                size_t targetIndex;
+                if (own != element->attributes.end()) {
+                    targetIndex = own - element->attributes.begin();
+                } else {
+                    auto added = std::ranges::find_if(addedTargets, [&target](const std::string &addedTarget) { return Generic::iequals(addedTarget, target); });
+                    if (added == addedTargets.end()) {
+                        added = addedTargets.insert(added, target);
                     }
+                    targetIndex = element->attributes.size() + (added - addedTargets.begin());
                 }
-            }
-            if (std::ranges::find(VOID_ELEMENTS, lowercaseType) == std::end(VOID_ELEMENTS)) {
-                if (!minify && hasChildren) {
-                    result += '\n';
-                    result += std::string(indentStart, ' ');
-                }
-                result += "</" + lowercaseType + ">";
+                attributes.bindings.push_back({std::move(source), static_cast<uint32_t>(targetIndex), std::string(attributeName(target))});
             }
         }
     }
-    return result;
+    text() += '<';
+    text() += lowercaseType;
+    if (attributes.bindings.empty()) {
+        for (const auto &attribute : element->attributes) {
+            attributeHelper(attribute, text());
+        }
+    } else {
+        for (const auto &attribute : element->attributes) {
+            attributeHelper(attribute, attributes.rendered.emplace_back());
+            attributes.names.emplace_back(attributeName(attribute->name));
+        }
+        plan.attributes.push_back(std::move(attributes));
+        emit(PlanOp::ATTRIBUTES, plan.attributes.size() - 1);
+    }
+    text() += '>';
+    auto isChildList = [](const Config::ConfigList &list) { return keyword(list.type) != Keyword::BINDINGS; };
+    bool hasChildren = std::ranges::any_of(element->lists, [&](const auto &list) { return isChildList(*list); });
+    tasks.emplace_back(CloseTask{std::move(lowercaseType), hasChildren, indentStart});
+    pushLists(element, isChildList, name, inTemplate, indentStart + format.indent());
 }
 
-std::string parseHTML(const Config::ConfigRoot &input, bool minify, size_t indent) {
-    std::map<std::string, const Config::ConfigElement*> templates;
-    if (input.elements.empty()) {
-        std::cerr << "(" << input.name << ")" << " No elements found in the root of an P(L)CLHTML file" << std::endl;
-        return "";
+template<typename Format>
+void PlanCompiler<Format>::closeElement(const CloseTask &task) {
+    if (std::ranges::find(VOID_ELEMENTS, task.lowercaseType) == std::end(VOID_ELEMENTS)) {
+        if (task.hasChildren) {
+            newline(task.indentStart);
+        }
+        text() += "</";
+        text() += task.lowercaseType;
+        text() += '>';
     }
-    if (input.elements.size() > 2) {
-        std::cerr << "(" << input.name << ")" << " A P(L)CLHTML file should contain only 1 or 2 elements in its root" << std::endl;
+}
+
+template<typename Format>
+void PlanCompiler<Format>::templateHelper(const Config::ConfigElement *element, TemplateId templateId, size_t indentStart) {
+    if (std::ranges::find(compiling, templateId) != compiling.end()) {
+        diagnostic(element->type) << "Template " << element->type << " instantiates itself";
+        return;
+    }
+    plan.instantiations++;
+    TraceSpan span("template", element->type);
+    const Config::ConfigElement *templateElement = templates.at(templateId);
+    auto variables = std::make_unique<VariableScope>();
+    templateVariables(element, templateElement, *variables);
+
+    auto key = std::make_tuple(templateId, indentStart, element->type);
+    auto it = bodies.find(key);
+    if (it != bodies.end()) {
+        callHelper(element, std::move(variables), it->second);
+        return;
+    }
+    compiling.push_back(templateId);
+    beginBlock();
+    tasks.emplace_back(TemplateTask{element, std::move(variables), std::move(key), std::move(span)});
+    pushLists(templateElement, isElementsList, element->type, true, indentStart);
+}
+
+template<typename Format>
+void PlanCompiler<Format>::finishTemplate(TemplateTask &task) {
+    PlanBlock body = endBlock();
+    compiling.pop_back();
+    auto it = bodies.emplace(std::move(task.key), body).first;
+    callHelper(task.element, std::move(task.variables), it->second);
+}
+
+template<typename Format>
+void PlanCompiler<Format>::callHelper(const Config::ConfigElement *element, std::unique_ptr<VariableScope> variables, const PlanBlock &body) {
+    // a body without bindings or loops doesn't need the variables, it's inlined as text
+    if (body.begin == body.end) {
+        return;
     }
+    if (body.end - body.begin == 1 && plan.instructions[body.begin].op == PlanOp::TEXT) {
+        const PlanInstruction &instruction = plan.instructions[body.begin];
+        text() += std::string_view(plan.text).substr(instruction.index, instruction.length);
+        return;
+    }
+    // identical instantiations share one call, so a fragment cache renders them once
+    uint64_t callKey = hashCombine(variables->hash(), body.begin);
+    std::vector<size_t> &candidates = calls[callKey];
+    for (size_t index : candidates) {
+        const PlanCall &call = plan.calls[index];
+        if (call.body.begin == body.begin && call.variables->sameVariables(*variables)) {
+            emit(PlanOp::CALL, index);
+            return;
+        }
+    }
+    plan.calls.push_back({element->type, variables.get(), body});
+    plan.scopes.push_back(std::move(variables));
+    candidates.push_back(plan.calls.size() - 1);
+    emit(PlanOp::CALL, plan.calls.size() - 1);
+}
 
+}
+
+void collectTemplates(const Config::ConfigRoot &input, TemplateRegistry &templates) {
     for (const auto &list: input.lists) {
-        if (Generic::iequals(list->type, "_templates")) {
+        Keyword listType = keyword(list->type);
+        if (listType == Keyword::TEMPLATES) {
             for (const auto &listElement : list->elements) {
                 const Config::ConfigElement* element = listElement->element;
                 if (element == nullptr) {
-                    std::cerr << "(" << input.name << ")" << " Unexpected null element in the _Templates list" << std::endl;
+                    diagnostic(input.name) << "Unexpected null element in the _Templates list";
                     continue;
                 }
-                if (!Generic::iequals(element->type, "Template")) {
-                    std::cerr << "(" << input.name << ")" << " Expected Template, got " << element->type << std::endl;
+                if (keyword(element->type) != Keyword::TEMPLATE) {
+                    diagnostic(input.name) << "Expected Template, got " << element->type;
                     continue;
                 }
                 std::string templateName;
@@ -455,74 +1060,101 @@ std::string parseHTML(const Config::ConfigRoot &input, bool minify, size_t inden
                     if (Generic::iequals(attribute->name, "Name")) {
                         templateName = attributeValueToString(attribute->value);
                     } else {
-                        std::cerr << "(" << input.name << ")" << " Expected Name, got " << attribute->name << std::endl;
+                        diagnostic(input.name) << "Expected Name, got " << attribute->name;
                     }
                 }
                 if (templateName.empty()) {
-                    std::cerr << "(" << input.name << ")" << " Template elements need to have the \"Name\" attribute. Ignoring template nr. " << listElement->id << std::endl;
+                    diagnostic(input.name) << "Template elements need to have the \"Name\" attribute. Ignoring template nr. " << listElement->id;
                     continue;
                 }
-                std::ranges::transform(templateName, templateName.begin(), ::tolower);
-                if (templates.contains(templateName)) {
-                    std::cerr << "(" << input.name << ")" << " Template " << templateName << " already exists. Ignoring template nr. " << listElement->id << std::endl;
-                    continue;
+                std::ranges::transform(templateName, templateName.begin(), asciiLower);
+                if (!templates.add(templateName, element)) {
+                    diagnostic(input.name) << "Template " << templateName << " already exists. Ignoring template nr. " << listElement->id;
                 }
-                templates.emplace(templateName, element);
             }
-        } else {
-            std::cerr << "(" << input.name << ")" << " Unexpected list: " << list->type << std::endl;
+        } else if (listType != Keyword::IMPORTS) {
+            diagnostic(input.name) << "Unexpected list: " << list->type;
         }
     }
+}
+
+RenderPlan compileHTML(const Config::ConfigRoot &input, bool minify, size_t indent, const std::vector<const TemplateRegistry*> &imports, size_t threads) {
+    RenderPlan plan;
+    TemplateRegistry templates;
+    if (input.elements.empty()) {
+        diagnostic(input.name) << "No elements found in the root of an P(L)CLHTML file";
+        return plan;
+    }
+    if (input.elements.size() > 2) {
+        diagnostic(input.name) << "A P(L)CLHTML file should contain only 1 or 2 elements in its root";
+    }
 
-    std::string result;
+    collectTemplates(input, templates);
+    // templates of the file itself take precedence over imported ones
+    for (const TemplateRegistry *library : imports) {
+        templates.addLibrary(*library);
+    }
 
-    for (auto &element : input.elements) {
-        if (Generic::iequals(element->type, "doctype")) {
-            if (element->attributes.empty()) {
-                std::cerr << "(" << input.name << ")" << " Doctype elements should have the \"Content\" attribute" << std::endl;
-            }
-            if (element->attributes.size() > 1) {
-                std::cerr << "(" << input.name << ")" << " Doctype elements shouldn't have more than 1 attribute" << std::endl;
-            }
-            for (const auto &attribute : element->attributes) {
-                if (Generic::iequals(attribute->name, "Content")) {
-                    if (std::holds_alternative<std::string>(attribute->value)) {
-                        result += "<!DOCTYPE " + std::get<std::string>(attribute->value) + ">";
-                        if (!minify) {
-                            result += "\n";
+    withFormatting(minify, indent, [&](auto format) {
+        PlanCompiler compiler(plan, templates, format, threads);
+        plan.root = compiler.block([&] {
+            for (auto &element : input.elements) {
+                Keyword type = keyword(element->type);
+                if (type == Keyword::DOCTYPE) {
+                    if (element->attributes.empty()) {
+                        diagnostic(input.name) << "Doctype elements should have the \"Content\" attribute";
+                    }
+                    if (element->attributes.size() > 1) {
+                        diagnostic(input.name) << "Doctype elements shouldn't have more than 1 attribute";
+                    }
+                    for (const auto &attribute : element->attributes) {
+                        if (Generic::iequals(attribute->name, "Content")) {
+                            if (std::holds_alternative<std::string>(attribute->value)) {
+                                compiler.text().append("<!DOCTYPE ").append(std::get<std::string>(attribute->value)).append(">");
+                                compiler.lineEnd();
+                            } else {
+                                diagnostic(input.name) << "Doctype elements should have a string value";
+                            }
                         }
-                    } else {
-                        std::cerr << "(" << input.name << ")" << " Doctype elements should have a string value" << std::endl;
                     }
+                    continue;
                 }
-            }
-            continue;
-        }
-        if (Generic::iequals(element->type, "html")) {
-            result += "<html";
-            if (!element->attributes.empty())
-                result += attributeHelper(element->attributes);
-            result += ">";
-            if (element->lists.empty()) {
-                std::cerr << "(" << input.name << ")" << " The HTML element should contain the \"Elements\" list" << std::endl;
-            }
-            if (element->lists.size() > 1) {
-                std::cerr << "(" << input.name << ")" << " The HTML element should contain only 1 list" << std::endl;
-            }
-            for (const auto &list : element->lists) {
-                if (Generic::iequals(list->type, "elements")) {
-                    result += listHelper(*list, input.name, templates, nullptr, minify, indent, indent);
-                    if (!minify) {
-                        result += "\n";
+                if (type == Keyword::HTML) {
+                    compiler.text() += "<html";
+                    for (const auto &attribute : element->attributes) {
+                        attributeHelper(attribute, compiler.text());
                     }
-                } else {
-                    std::cerr << "(" << input.name << ")" << " Unexpected list: " << list->type << std::endl;
+                    compiler.text() += '>';
+                    if (element->lists.empty()) {
+                        diagnostic(input.name) << "The HTML element should contain the \"Elements\" list";
+                    }
+                    if (element->lists.size() > 1) {
+                        diagnostic(input.name) << "The HTML element should contain only 1 list";
+                    }
+                    for (const auto &list : element->lists) {
+                        if (keyword(list->type) == Keyword::ELEMENTS) {
+                            compiler.listHelper(*list, input.name, false, compiler.indent());
+                            compiler.lineEnd();
+                        } else {
+                            diagnostic(input.name) << "Unexpected list: " << list->type;
+                        }
+                    }
+                    compiler.text() += "</html>";
+                    continue;
                 }
+                diagnostic(input.name) << "Unexpected element: " << element->type;
             }
-            result += "</html>";
-            continue;
-        }
-        std::cerr << "(" << input.name << ")" << " Unexpected element: " << element->type << std::endl;
-    }
-    return result;
-}
\ No newline at end of file
+        });
+    });
+    return plan;
+}
+
+void parseHTML(const Config::ConfigRoot &input, bool minify, size_t indent, OutputSink &output, const std::vector<const TemplateRegistry*> &imports) {
+    renderPlan(compileHTML(input, minify, indent, imports), output);
+}
+
+std::string parseHTML(const Config::ConfigRoot &input, bool minify, size_t indent) {
+    OutputSink output;
+    parseHTML(input, minify, indent, output, {});
+    return output.take();
+}
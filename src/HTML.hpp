@@ -2,9 +2,15 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <iostream>
+#include <unordered_map>
 #include <libPLCL.hpp>
 
+#include "AttributeNames.hpp"
+#include "Sink.hpp"
+
 using namespace PLCL;
 
 inline const std::string VOID_ELEMENTS[] = {
@@ -33,6 +39,82 @@ enum VariableValueType {
 };
 
 typedef std::vector<std::string> LiteralArray;
-typedef std::variant<std::string, LiteralArray, Config::ConfigElement> VariableValue; // maybe make it lighter
+// doesn't own the value, literals and arrays built from attributes are kept alive by their VariableScope
+typedef std::variant<std::string_view, const LiteralArray*, const Config::ConfigElement*> VariableValue;
+
+// One frame of variables. Every template instantiation starts a new chain and every _BindingLoop
+// links a single-variable frame to the enclosing one, so neither has to copy the variables around it.
+class VariableScope {
+public:
+    explicit VariableScope(const VariableScope *parent = nullptr) : parent(parent) {}
+    VariableScope(const VariableScope &) = delete;
+    VariableScope &operator=(const VariableScope &) = delete;
+
+    // searches this frame first, then the enclosing ones
+    [[nodiscard]] const VariableValue *find(std::string_view name) const;
+    // only searches this frame
+    [[nodiscard]] bool contains(std::string_view name) const;
+    // the returned reference stays valid until the next add
+    VariableValue &add(std::string name, VariableValue value);
+    // keeps the value alive for as long as the scope
+    std::string_view store(std::string value);
+    const LiteralArray *store(LiteralArray value);
+    // compares only this frame, literals and arrays by content and elements by identity
+    [[nodiscard]] bool sameVariables(const VariableScope &other) const;
+    // consistent with sameVariables
+    [[nodiscard]] uint64_t hash() const;
+
+private:
+    const VariableScope *parent;
+    // frames only hold a handful of variables, a linear search beats hashing
+    std::vector<std::pair<std::string, VariableValue>> variables;
+    std::deque<std::string> strings;
+    std::deque<LiteralArray> arrays;
+};
+
+typedef uint32_t TemplateId;
+
+// Every template a document can use, built once per parseHTML and shared by all instantiations.
+// Names are interned into ids, looked up case-insensitively without building lowercase copies.
+// Imported libraries keep registries of their own, collected once when they're loaded, which the
+// document's registry falls back to instead of copying them.
+class TemplateRegistry {
+public:
+    static constexpr TemplateId NOT_FOUND = UINT32_MAX;
+
+    // returns false if a template with that name already exists
+    bool add(std::string_view name, const Config::ConfigElement *element);
+    // names not found here are looked up in the libraries, in the order they were added
+    // the library's registry has to outlive this one
+    void addLibrary(const TemplateRegistry &library);
+    [[nodiscard]] TemplateId find(std::string_view name) const;
+    [[nodiscard]] const Config::ConfigElement *at(TemplateId id) const;
+    // including the templates of the libraries
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const;
+    };
+    struct NameEquals {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const;
+    };
+
+    std::unordered_map<std::string, TemplateId, NameHash, NameEquals> ids;
+    std::vector<std::string_view> names;
+    std::vector<const Config::ConfigElement*> elements;
+    // the ids of a library's templates follow the ones of the libraries before it
+    std::vector<const TemplateRegistry*> libraries;
+};
+
+// collects the templates of the _Templates list into the registry, _Imports are resolved by the caller
+void collectTemplates(const Config::ConfigRoot &input, TemplateRegistry &templates);
+
+// renders an attribute with its own value, including the leading space
+void attributeHelper(const Config::ConfigElementAttribute *attribute, std::string &output);
 
 std::string parseHTML(const Config::ConfigRoot &input, bool minify, size_t indent);
+// imports are the registries of the imported template libraries, in import order
+void parseHTML(const Config::ConfigRoot &input, bool minify, size_t indent, OutputSink &output, const std::vector<const TemplateRegistry*> &imports);
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a, stable across runs and platforms unlike std::hash
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+constexpr uint64_t hashBytes(std::string_view bytes, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (char byte : bytes) {
+        hash ^= static_cast<unsigned char>(byte);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+constexpr uint64_t hashCombine(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// ASCII only and defined for every byte, unlike ::tolower on a negative char
+constexpr char asciiLower(char byte) {
+    return (byte >= 'A' && byte <= 'Z') ? static_cast<char>(byte + ('a' - 'A')) : byte;
+}
+
+// same as hashBytes on the ASCII-lowercased bytes, without building the lowercase string
+constexpr uint64_t hashBytesCaseInsensitive(std::string_view bytes, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (char byte : bytes) {
+        hash ^= static_cast<unsigned char>(asciiLower(byte));
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
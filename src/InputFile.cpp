@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <utility>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+#include "InputFile.hpp"
+
+#ifdef __linux__
+
+namespace {
+
+// reads until the end of the file, the buffer is already sized for what fstat reported
+bool readAll(int fd, std::string &buffer) {
+    size_t size = 0;
+    while (true) {
+        if (size == buffer.size()) {
+            // pipes report no size and files can grow while they're read
+            buffer.resize(buffer.empty() ? 64 * 1024 : buffer.size() * 2);
+        }
+        ssize_t count = ::read(fd, buffer.data() + size, buffer.size() - size);
+        if (count == 0) {
+            break;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size += static_cast<size_t>(count);
+    }
+    buffer.resize(size);
+    return true;
+}
+
+}
+
+std::optional<InputFile> InputFile::read(const std::filesystem::path &file, Access access) {
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    InputFile input;
+    struct stat status{};
+    bool regular = ::fstat(fd, &status) == 0 && S_ISREG(status.st_mode);
+    auto size = regular ? static_cast<size_t>(status.st_size) : 0;
+    if (access == Access::Map && size >= MAP_THRESHOLD) {
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // the parser goes through it once, front to back
+            ::madvise(mapping, size, MADV_SEQUENTIAL);
+            ::close(fd);
+            input.mapping = mapping;
+            input.mappedSize = size;
+            return input;
+        }
+    }
+    // one more byte than reported, so a file that didn't grow is read in one go and its end seen by the next read
+    input.buffer.resize(size + 1);
+    bool success = readAll(fd, input.buffer);
+    ::close(fd);
+    if (!success) {
+        return std::nullopt;
+    }
+    return input;
+}
+
+void InputFile::unmap() {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mappedSize);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+}
+
+#else
+
+std::optional<InputFile> InputFile::read(const std::filesystem::path &file, Access) {
+    std::ifstream ifs(file, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        return std::nullopt;
+    }
+    InputFile input;
+    std::streamsize size = ifs.tellg();
+    if (size > 0) {
+        ifs.seekg(0);
+        input.buffer.resize(static_cast<size_t>(size));
+        ifs.read(input.buffer.data(), size);
+        input.buffer.resize(static_cast<size_t>(ifs.gcount()));
+    } else {
+        // no size to go by, like for a pipe
+        ifs.clear();
+        ifs.seekg(0);
+        input.buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    return input;
+}
+
+void InputFile::unmap() {}
+
+#endif
+
+InputFile::InputFile(InputFile &&other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)), mappedSize(std::exchange(other.mappedSize, 0)), buffer(std::move(other.buffer)) {}
+
+InputFile &InputFile::operator=(InputFile &&other) noexcept {
+    if (this != &other) {
+        unmap();
+        mapping = std::exchange(other.mapping, nullptr);
+        mappedSize = std::exchange(other.mappedSize, 0);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+InputFile::~InputFile() {
+    unmap();
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// The content of an input file. Large regular files can be memory-mapped on Linux and read straight
+// from the page cache, everything else (small files, pipes, other platforms) is read into a buffer
+// sized up front, so the content is never copied a character at a time or reallocated as it grows.
+class InputFile {
+public:
+    // files below this size are read, mapping them costs more than copying them
+    static constexpr size_t MAP_THRESHOLD = 64 * 1024;
+
+    enum class Access {
+        // copied into a buffer, safe while other processes rewrite the file
+        Read,
+        // mapped from MAP_THRESHOLD on, touching the mapping after the file got truncated raises SIGBUS,
+        // so only for files nothing rewrites while they're in use, like the inputs of a single build
+        Map,
+    };
+
+    // nullopt if the file couldn't be opened or read
+    static std::optional<InputFile> read(const std::filesystem::path &file, Access access = Access::Read);
+
+    InputFile(InputFile &&other) noexcept;
+    InputFile &operator=(InputFile &&other) noexcept;
+    InputFile(const InputFile &) = delete;
+    InputFile &operator=(const InputFile &) = delete;
+    ~InputFile();
+
+    // valid for as long as the InputFile
+    [[nodiscard]] std::string_view view() const {
+        return mapping != nullptr ? std::string_view(static_cast<const char*>(mapping), mappedSize) : std::string_view(buffer);
+    }
+    [[nodiscard]] bool mapped() const {
+        return mapping != nullptr;
+    }
+
+private:
+    InputFile() = default;
+    void unmap();
+
+    void *mapping = nullptr;
+    size_t mappedSize = 0;
+    std::string buffer;
+};
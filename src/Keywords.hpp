@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "Hash.hpp"
+
+// Element, list and attribute names with a meaning of their own. Every node is classified once with
+// keyword() and the emitters switch on the result instead of comparing against each name in turn.
+enum class Keyword : uint8_t {
+    NONE,
+    TEXT,
+    RAW_HTML,
+    BINDING_LOOP,
+    BINDINGS,
+    BINDING,
+    ELEMENTS,
+    ELEMENT,
+    VARIABLES,
+    VARIABLE,
+    VARIABLE_VALUES,
+    VARIABLE_VALUE,
+    VALUE,
+    LITERAL,
+    LITERAL_ARRAY,
+    LITERAL_LIST,
+    DOCTYPE,
+    HTML,
+    TEMPLATES,
+    TEMPLATE,
+    IMPORTS,
+    IMPORT,
+    PSEUDO_CLASSES,
+    PSEUDO_ELEMENTS,
+    TYPE,
+    ALL,
+    CLASS,
+    ID,
+    TAG,
+};
+
+struct KeywordName {
+    std::string_view name;
+    Keyword keyword;
+};
+
+// lowercase, names are matched case-insensitively
+inline constexpr KeywordName KEYWORDS[] = {
+    {"_text", Keyword::TEXT},
+    {"_rawhtml", Keyword::RAW_HTML},
+    {"_bindingloop", Keyword::BINDING_LOOP},
+    {"_bindings", Keyword::BINDINGS},
+    {"binding", Keyword::BINDING},
+    {"elements", Keyword::ELEMENTS},
+    {"element", Keyword::ELEMENT},
+    {"variables", Keyword::VARIABLES},
+    {"variable", Keyword::VARIABLE},
+    {"variablevalues", Keyword::VARIABLE_VALUES},
+    {"variablevalue", Keyword::VARIABLE_VALUE},
+    {"value", Keyword::VALUE},
+    {"literal", Keyword::LITERAL},
+    {"literalarray", Keyword::LITERAL_ARRAY},
+    {"_literallist", Keyword::LITERAL_LIST},
+    {"doctype", Keyword::DOCTYPE},
+    {"html", Keyword::HTML},
+    {"_templates", Keyword::TEMPLATES},
+    {"template", Keyword::TEMPLATE},
+    {"_imports", Keyword::IMPORTS},
+    {"import", Keyword::IMPORT},
+    {"_pseudoclasses", Keyword::PSEUDO_CLASSES},
+    {"_pseudoelements", Keyword::PSEUDO_ELEMENTS},
+    {"_type", Keyword::TYPE},
+    {"_all", Keyword::ALL},
+    {"class", Keyword::CLASS},
+    {"id", Keyword::ID},
+    {"tag", Keyword::TAG},
+};
+
+inline constexpr size_t KEYWORD_MIN_LENGTH = 2;
+inline constexpr size_t KEYWORD_MAX_LENGTH = 15;
+inline constexpr size_t KEYWORD_SLOT_BITS = 7;
+inline constexpr size_t KEYWORD_SLOTS = size_t(1) << KEYWORD_SLOT_BITS;
+
+// only looks at the length and the first and last two bytes, so long names cost as much as short ones
+constexpr size_t keywordSlot(std::string_view name, uint64_t multiplier) {
+    char ends[] = {name[0], name[1], name[name.size() - 2], name[name.size() - 1]};
+    uint64_t hash = hashBytesCaseInsensitive(std::string_view(ends, sizeof(ends)), hashCombine(FNV_OFFSET_BASIS, name.size()));
+    return (hash * multiplier) >> (64 - KEYWORD_SLOT_BITS);
+}
+
+// the first odd multiplier the keywords don't collide for, found while compiling
+inline constexpr uint64_t KEYWORD_MULTIPLIER = [] {
+    for (uint64_t multiplier = FNV_PRIME;; multiplier += 2) {
+        std::array<bool, KEYWORD_SLOTS> taken{};
+        bool collision = false;
+        for (const auto &[name, keyword] : KEYWORDS) {
+            size_t slot = keywordSlot(name, multiplier);
+            collision = collision || taken[slot];
+            taken[slot] = true;
+        }
+        if (!collision) {
+            return multiplier;
+        }
+    }
+}();
+
+// KEYWORDS index + 1 per slot, 0 for empty ones
+inline constexpr auto KEYWORD_TABLE = [] {
+    std::array<uint8_t, KEYWORD_SLOTS> table{};
+    for (size_t i = 0; i < std::size(KEYWORDS); i++) {
+        table[keywordSlot(KEYWORDS[i].name, KEYWORD_MULTIPLIER)] = static_cast<uint8_t>(i + 1);
+    }
+    return table;
+}();
+
+constexpr Keyword keyword(std::string_view name) {
+    if (name.size() < KEYWORD_MIN_LENGTH || name.size() > KEYWORD_MAX_LENGTH) {
+        return Keyword::NONE;
+    }
+    uint8_t entry = KEYWORD_TABLE[keywordSlot(name, KEYWORD_MULTIPLIER)];
+    if (entry == 0) {
+        return Keyword::NONE;
+    }
+    const KeywordName &candidate = KEYWORDS[entry - 1];
+    if (candidate.name.size() != name.size()) {
+        return Keyword::NONE;
+    }
+    for (size_t i = 0; i < name.size(); i++) {
+        char c = name[i];
+        if ((c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c) != candidate.name[i]) {
+            return Keyword::NONE;
+        }
+    }
+    return candidate.keyword;
+}
+
+static_assert(std::ranges::all_of(KEYWORDS, [](const KeywordName &entry) { return keyword(entry.name) == entry.keyword; }));
+static_assert(keyword("_BindingLoop") == Keyword::BINDING_LOOP && keyword("Div") == Keyword::NONE);
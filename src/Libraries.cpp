@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <unordered_set>
+#include <libPLCLToWeb.hpp>
+
+#include "Diagnostics.hpp"
+#include "InputFile.hpp"
+#include "Keywords.hpp"
+#include "Libraries.hpp"
+
+std::vector<std::filesystem::path> importsOf(const std::filesystem::path &file, const Config::ConfigRoot &root) {
+    std::vector<std::filesystem::path> result;
+    for (const auto &list : root.lists) {
+        if (keyword(list->type) != Keyword::IMPORTS) {
+            continue;
+        }
+        for (const auto &listElement : list->elements) {
+            const Config::ConfigElement *element = listElement->element;
+            if (element == nullptr) {
+                diagnostic(root.name) << "Unexpected null element in the _Imports list";
+                continue;
+            }
+            if (keyword(element->type) != Keyword::IMPORT) {
+                diagnostic(root.name) << "Expected Import, got " << element->type;
+                continue;
+            }
+            std::string path;
+            for (const auto &attribute : element->attributes) {
+                if (Generic::iequals(attribute->name, "Path")) {
+                    path = attributeValueToString(attribute->value);
+                } else {
+                    diagnostic(root.name) << "Expected Path, got " << attribute->name;
+                }
+            }
+            if (path.empty()) {
+                diagnostic(root.name) << "Import elements need to have the \"Path\" attribute. Ignoring import nr. " << listElement->id;
+                continue;
+            }
+            result.push_back(std::filesystem::absolute(file.parent_path() / path).lexically_normal());
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<const TemplateLibrary> TemplateLibraries::load(const std::filesystem::path &file) {
+    std::promise<std::shared_ptr<const TemplateLibrary>> promise;
+    std::shared_future<std::shared_ptr<const TemplateLibrary>> future;
+    {
+        std::lock_guard lock(mutex);
+        auto it = cache.find(file);
+        if (it != cache.end()) {
+            future = it->second;
+        } else {
+            cache.emplace(file, promise.get_future().share());
+        }
+    }
+    // another thread is already parsing it
+    if (future.valid()) {
+        return future.get();
+    }
+
+    std::shared_ptr<TemplateLibrary> library;
+    std::optional<InputFile> input = InputFile::read(file);
+    if (input) {
+        try {
+            library = std::make_shared<TemplateLibrary>(file, Config::ConfigRoot::fromString(std::string(input->view())));
+            library->imports = importsOf(file, library->root);
+            // its diagnostics are reported once, by the file that loaded it
+            if (PLCLToWeb::languageOf(file) == PLCLToWeb::Language::HTML) {
+                collectTemplates(library->root, library->templates);
+            }
+        } catch (...) {
+            // threads waiting for it get the parse error too, later imports parse it again
+            promise.set_exception(std::current_exception());
+            std::lock_guard lock(mutex);
+            cache.erase(file);
+            throw;
+        }
+    } else {
+        diagnostic() << "Failed to open imported file " << file.string();
+        // don't cache the failure, the file might show up later
+        std::lock_guard lock(mutex);
+        cache.erase(file);
+    }
+    promise.set_value(library);
+    return library;
+}
+
+std::vector<std::shared_ptr<const TemplateLibrary>> TemplateLibraries::resolve(const std::filesystem::path &file, const Config::ConfigRoot &root) {
+    std::vector<std::shared_ptr<const TemplateLibrary>> result;
+    std::vector<std::filesystem::path> direct = importsOf(file, root);
+    recordImports(file, direct);
+
+    std::unordered_set<std::filesystem::path, PathHash> visited{file};
+    // depth first, so every library comes right after the file importing it
+    std::vector<std::filesystem::path> stack(direct.rbegin(), direct.rend());
+    while (!stack.empty()) {
+        std::filesystem::path current = std::move(stack.back());
+        stack.pop_back();
+        if (!visited.insert(current).second) {
+            continue;
+        }
+        std::shared_ptr<const TemplateLibrary> library = load(current);
+        if (library == nullptr) {
+            continue;
+        }
+        recordImports(current, library->imports);
+        stack.insert(stack.end(), library->imports.rbegin(), library->imports.rend());
+        result.push_back(std::move(library));
+    }
+    return result;
+}
+
+void TemplateLibraries::invalidate(const std::filesystem::path &file) {
+    std::lock_guard lock(mutex);
+    cache.erase(file);
+}
+
+void TemplateLibraries::recordImports(const std::filesystem::path &file, const std::vector<std::filesystem::path> &fileImports) {
+    std::lock_guard lock(mutex);
+    imports.insert_or_assign(file, fileImports);
+}
+
+std::unordered_set<std::filesystem::path, PathHash> TemplateLibraries::dependents(const std::filesystem::path &file) const {
+    std::lock_guard lock(mutex);
+    std::unordered_map<std::filesystem::path, std::vector<std::filesystem::path>, PathHash> importedBy;
+    for (const auto &[importer, fileImports] : imports) {
+        for (const auto &imported : fileImports) {
+            importedBy[imported].push_back(importer);
+        }
+    }
+    std::unordered_set<std::filesystem::path, PathHash> result;
+    std::vector<std::filesystem::path> stack{file};
+    while (!stack.empty()) {
+        std::filesystem::path current = std::move(stack.back());
+        stack.pop_back();
+        auto it = importedBy.find(current);
+        if (it == importedBy.end()) {
+            continue;
+        }
+        for (const auto &importer : it->second) {
+            if (result.insert(importer).second) {
+                stack.push_back(importer);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<std::filesystem::path> TemplateLibraries::dependencies(const std::filesystem::path &file) const {
+    std::lock_guard lock(mutex);
+    std::vector<std::filesystem::path> result;
+    std::unordered_set<std::filesystem::path, PathHash> visited{file};
+    std::vector<std::filesystem::path> stack{file};
+    while (!stack.empty()) {
+        std::filesystem::path current = std::move(stack.back());
+        stack.pop_back();
+        auto it = imports.find(current);
+        if (it == imports.end()) {
+            continue;
+        }
+        for (const auto &imported : it->second) {
+            if (visited.insert(imported).second) {
+                result.push_back(imported);
+                stack.push_back(imported);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<std::filesystem::path> TemplateLibraries::libraries() const {
+    std::lock_guard lock(mutex);
+    std::unordered_set<std::filesystem::path, PathHash> seen;
+    std::vector<std::filesystem::path> result;
+    for (const auto &[importer, fileImports] : imports) {
+        for (const auto &imported : fileImports) {
+            if (seen.insert(imported).second) {
+                result.push_back(imported);
+            }
+        }
+    }
+    return result;
+}
+
+TemplateLibraries &templateLibraries() {
+    static TemplateLibraries libraries;
+    return libraries;
+}
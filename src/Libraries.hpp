@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <libPLCL.hpp>
+
+#include "Generic.hpp"
+#include "HTML.hpp"
+
+using namespace PLCL;
+
+// A file imported through the _Imports list, only its _Templates (and _Imports) are used.
+struct TemplateLibrary {
+    std::filesystem::path path;
+    Config::ConfigRoot root;
+    std::vector<std::filesystem::path> imports;
+    // collected once when a P(L)CLHTML library is loaded, every importing document falls back to it
+    TemplateRegistry templates;
+};
+
+// Template libraries parsed once per process and shared by every file importing them,
+// along with the file level dependency graph, so a changed library only rebuilds its dependents.
+class TemplateLibraries {
+public:
+    // loads everything the file imports, transitively, in import order, and records the file's imports
+    std::vector<std::shared_ptr<const TemplateLibrary>> resolve(const std::filesystem::path &file, const Config::ConfigRoot &root);
+    // records the imports of a file that wasn't resolved, like one skipped by the build cache
+    void recordImports(const std::filesystem::path &file, const std::vector<std::filesystem::path> &fileImports);
+    // drops the cached library, the next resolve parses it again
+    void invalidate(const std::filesystem::path &file);
+    // every file importing the file, directly or through other libraries
+    std::unordered_set<std::filesystem::path, PathHash> dependents(const std::filesystem::path &file) const;
+    // every file the file imports, directly or through other libraries
+    std::vector<std::filesystem::path> dependencies(const std::filesystem::path &file) const;
+    // every imported file seen so far
+    std::vector<std::filesystem::path> libraries() const;
+
+private:
+    std::shared_ptr<const TemplateLibrary> load(const std::filesystem::path &file);
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::filesystem::path, std::shared_future<std::shared_ptr<const TemplateLibrary>>, PathHash> cache;
+    std::unordered_map<std::filesystem::path, std::vector<std::filesystem::path>, PathHash> imports;
+};
+
+// the paths listed in the _Imports list of the root, relative to the file's directory
+std::vector<std::filesystem::path> importsOf(const std::filesystem::path &file, const Config::ConfigRoot &root);
+
+TemplateLibraries &templateLibraries();
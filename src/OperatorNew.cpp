@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdlib>
+#include <new>
+
+#include "Allocations.hpp"
+
+// the nothrow forms of the standard library forward to these, the aligned ones allocate and free on
+// their own and aren't counted. The array and sized forms are replaced too, so no standard library
+// decides whether a delete goes through the counter
+void *operator new(std::size_t size) {
+    for (;;) {
+        if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+            AllocationTracker::allocated(pointer);
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void *pointer) noexcept {
+    AllocationTracker::freed(pointer);
+    std::free(pointer);
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    ::operator delete(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    ::operator delete(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+    ::operator delete(pointer);
+}
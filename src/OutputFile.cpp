@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "OutputFile.hpp"
+
+namespace {
+
+// unique per process, the process id keeps concurrent builds apart
+std::filesystem::path temporaryPath(const std::filesystem::path &path) {
+    static std::atomic<uint64_t> counter = 0;
+    std::string suffix = ".tmp";
+#ifdef __linux__
+    suffix += std::to_string(::getpid()) + '.';
+#endif
+    suffix += std::to_string(counter++);
+    std::filesystem::path result = path;
+    result += suffix;
+    return result;
+}
+
+}
+
+OutputFile::OutputFile(std::filesystem::path path, bool sync) : path(std::move(path)), sync(sync) {
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(this->path, ec)) {
+        // read rather than mapped, a concurrent build or a client of --serve may truncate it meanwhile
+        existing = InputFile::read(this->path);
+    }
+}
+
+OutputFile::~OutputFile() {
+    if (!diverged || committed) {
+        return;
+    }
+#ifdef __linux__
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#else
+    stream.close();
+#endif
+    std::error_code ec;
+    std::filesystem::remove(temporary, ec);
+}
+
+bool OutputFile::write(std::string_view chunk) {
+    if (failed) {
+        return false;
+    }
+    if (diverged) {
+        return writeAll({}, chunk);
+    }
+    if (existing) {
+        std::string_view rest = existing->view().substr(matched);
+        if (chunk.size() <= rest.size() && std::memcmp(chunk.data(), rest.data(), chunk.size()) == 0) {
+            matched += chunk.size();
+            return true;
+        }
+    }
+    return diverge(chunk);
+}
+
+bool OutputFile::diverge(std::string_view chunk) {
+    diverged = true;
+    temporary = temporaryPath(path);
+#ifdef __linux__
+    fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    failed = fd < 0;
+#else
+    stream.open(temporary, std::ios::binary);
+    failed = !stream;
+#endif
+    if (failed) {
+        return false;
+    }
+    std::string_view prefix = existing ? existing->view().substr(0, matched) : std::string_view();
+    return writeAll(prefix, chunk);
+}
+
+#ifdef __linux__
+
+// both pieces in as few writev calls as the kernel takes
+bool OutputFile::writeAll(std::string_view prefix, std::string_view chunk) {
+    iovec pieces[2] = {
+        {const_cast<char*>(prefix.data()), prefix.size()},
+        {const_cast<char*>(chunk.data()), chunk.size()},
+    };
+    iovec *next = pieces;
+    int count = 2;
+    while (count > 0) {
+        if (next->iov_len == 0) {
+            next++;
+            count--;
+            continue;
+        }
+        ssize_t written = ::writev(fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            return false;
+        }
+        auto remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= next->iov_len) {
+            remaining -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + remaining;
+            next->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+#else
+
+bool OutputFile::writeAll(std::string_view prefix, std::string_view chunk) {
+    stream.write(prefix.data(), static_cast<std::streamsize>(prefix.size()));
+    stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    failed = !stream;
+    return !failed;
+}
+
+#endif
+
+bool OutputFile::commit() {
+    if (failed) {
+        return false;
+    }
+    // a shorter output matches a prefix of the existing file, it still has to be written
+    if (!diverged && existing && matched == existing->view().size()) {
+        committed = true;
+        return true;
+    }
+    if (!diverged && !diverge({})) {
+        return false;
+    }
+#ifdef __linux__
+    // on disk before the rename, or a crash could leave the new name pointing at an empty file
+    bool closed = !sync || ::fsync(fd) == 0;
+    closed = ::close(fd) == 0 && closed;
+    fd = -1;
+#else
+    stream.close();
+    bool closed = static_cast<bool>(stream);
+#endif
+    if (!closed) {
+        failed = true;
+        return false;
+    }
+    std::error_code ec;
+    // keeps the permissions someone gave the existing file
+    std::filesystem::file_status status = std::filesystem::status(path, ec);
+    if (!ec && std::filesystem::exists(status)) {
+        std::filesystem::permissions(temporary, status.permissions(), ec);
+    }
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        failed = true;
+        return false;
+    }
+    committed = true;
+    return true;
+}
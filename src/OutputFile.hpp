@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string_view>
+
+#include "InputFile.hpp"
+
+// An output file that's only written if its content changes. Chunks are compared against the existing
+// file while they come in, nothing is written as long as they match. The first difference starts a
+// temporary file next to it, which gets the matching prefix and everything after it and replaces the
+// existing file by renaming it on commit, so readers never see a half-written file and unchanged
+// outputs keep their modification time.
+class OutputFile {
+public:
+    // with sync the content reaches the disk before the rename on Linux, so a crash can't leave the
+    // output empty. That's an fsync per written file, which outputs that can be rebuilt don't need
+    explicit OutputFile(std::filesystem::path path, bool sync = false);
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    // removes the temporary file unless it was committed
+    ~OutputFile();
+
+    // returns false once writing failed, the rest of the chunks are ignored then
+    bool write(std::string_view chunk);
+    // returns false if the file couldn't be written, the existing one is left as it was then. Without
+    // a commit the existing file is left as it was too, failed compiles must not replace a good output
+    bool commit();
+    // only meaningful after commit
+    [[nodiscard]] bool changed() const {
+        return diverged;
+    }
+
+private:
+    // opens the temporary file and writes the matched prefix along with the chunk
+    bool diverge(std::string_view chunk);
+    bool writeAll(std::string_view prefix, std::string_view chunk);
+
+    std::filesystem::path path;
+    std::filesystem::path temporary;
+    std::optional<InputFile> existing;
+    // bytes that matched the existing file so far
+    size_t matched = 0;
+    bool diverged = false;
+    bool failed = false;
+    bool committed = false;
+    bool sync;
+#ifdef __linux__
+    int fd = -1;
+#else
+    std::ofstream stream;
+#endif
+};
@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include "RenderPlan.hpp"
+#include "Allocations.hpp"
+#include "Diagnostics.hpp"
+#include "Escape.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+namespace {
+
+void bindingHelper(const PlanBinding &binding, const VariableScope *variables, OutputSink &output) {
+    if (const VariableValue *value = variables->find(binding.source)) {
+        if (!std::holds_alternative<std::string_view>(*value)) {
+            diagnostic(binding.name) << "Binding variable " << binding.source << " is not a Literal";
+        } else if (binding.raw) {
+            output << std::get<std::string_view>(*value);
+        } else {
+            escapeHTML(std::get<std::string_view>(*value), EscapeContext::TEXT, output);
+        }
+    } else {
+        diagnostic(binding.name) << "Binding variable " << binding.source << " not found in variables";
+    }
+}
+
+void attributesHelper(const PlanAttributes &attributes, const VariableScope *variables, OutputSink &output) {
+    std::vector<std::optional<std::string_view>> overrides(attributes.rendered.size());
+    // slot, name and value of the added attributes, in the order they were first bound
+    std::vector<std::tuple<uint32_t, std::string_view, std::string_view>> added;
+    for (const auto &binding : attributes.bindings) {
+        const VariableValue *value = variables->find(binding.source);
+        if (value == nullptr) {
+            diagnostic(attributes.name) << "Binding variable " << binding.source << " not found in variables";
+            continue;
+        }
+        std::string_view stringValue;
+        if (std::holds_alternative<std::string_view>(*value)) {
+            stringValue = std::get<std::string_view>(*value);
+        } else if (std::holds_alternative<const LiteralArray*>(*value)) {
+            diagnostic(attributes.name) << "_BindingLoop not used for a LiteralArray. Getting the first element";
+            stringValue = std::get<const LiteralArray*>(*value)->at(0);
+        } else if (std::holds_alternative<const Config::ConfigElement*>(*value)) {
+            diagnostic() << "FIXME: ELEMENT";
+            stringValue = "FIXME: ELEMENT";
+        }
+        if (binding.target < overrides.size()) {
+            overrides[binding.target] = stringValue;
+            continue;
+        }
+        auto it = std::ranges::find(added, binding.target, [](const auto &entry) { return std::get<0>(entry); });
+        if (it != added.end()) {
+            std::get<2>(*it) = stringValue;
+        } else {
+            added.emplace_back(binding.target, binding.targetName, stringValue);
+        }
+    }
+    for (size_t i = 0; i < overrides.size(); i++) {
+        if (overrides[i]) {
+            output << ' ' << attributes.names[i] << "=\"";
+            escapeHTML(*overrides[i], EscapeContext::ATTRIBUTE, output);
+            output << '"';
+        } else {
+            output << attributes.rendered[i];
+        }
+    }
+    for (const auto &[slot, name, value] : added) {
+        output << ' ' << name << "=\"";
+        escapeHTML(value, EscapeContext::ATTRIBUTE, output);
+        output << '"';
+    }
+}
+
+}
+
+PlanRenderer::PlanRenderer(const RenderPlan &plan, FragmentCache *fragments) : PlanRenderer(plan, plan.root, fragments) {}
+
+PlanRenderer::PlanRenderer(const RenderPlan &plan, PlanBlock block, FragmentCache *fragments) : plan(plan), fragments(fragments) {
+    if (fragments != nullptr) {
+        fragments->fragments.resize(plan.calls.size());
+    }
+    frames.push_back({.begin = block.begin, .next = block.begin, .end = block.end, .variables = nullptr});
+}
+
+bool PlanRenderer::resume(OutputSink &output, size_t budget) {
+    size_t start = output.size();
+    while (!frames.empty()) {
+        if (output.size() - start >= budget) {
+            return false;
+        }
+        Frame &frame = frames.back();
+        if (frame.next == frame.end) {
+            finish(output);
+            continue;
+        }
+        const PlanInstruction &instruction = plan.instructions[frame.next++];
+        OutputSink &target = frame.capture != nullptr ? *frame.capture : output;
+        switch (instruction.op) {
+            case PlanOp::TEXT:
+                target << std::string_view(plan.text).substr(instruction.index, instruction.length);
+                break;
+            case PlanOp::BINDING:
+                bindingHelper(plan.bindings[instruction.index], frame.variables, target);
+                break;
+            case PlanOp::LOOP:
+                loopHelper(plan.loops[instruction.index], frame.variables, frame.capture);
+                break;
+            case PlanOp::CALL:
+                callHelper(instruction.index, frame.capture, output);
+                break;
+            case PlanOp::ATTRIBUTES:
+                attributesHelper(plan.attributes[instruction.index], frame.variables, target);
+                break;
+        }
+    }
+    return true;
+}
+
+void PlanRenderer::loopHelper(const PlanLoop &loop, const VariableScope *variables, OutputSink *capture) {
+    const VariableValue *value = variables->find(loop.source);
+    if (value == nullptr) {
+        diagnostic(loop.name) << "Binding variable " << loop.source << " not found in variables";
+        return;
+    }
+    if (!std::holds_alternative<const LiteralArray*>(*value)) {
+        diagnostic(loop.name) << "Binding variable " << loop.source << " is not a LiteralArray";
+        return;
+    }
+    const LiteralArray *literals = std::get<const LiteralArray*>(*value);
+    // one frame for the whole loop, every iteration only swaps the value
+    auto loopVariables = std::make_unique<VariableScope>(variables);
+    VariableScope *scope = loopVariables.get();
+    VariableValue &current = scope->add(loop.source, std::string_view());
+    Frame &frame = frames.emplace_back(Frame{
+        .begin = loop.body.begin,
+        .next = loop.body.begin,
+        .end = loop.body.end,
+        .variables = scope,
+        .capture = capture,
+        .loopVariables = std::move(loopVariables),
+        .current = &current,
+        .literals = literals,
+        .span = TraceSpan("loop", loop.source),
+    });
+    if (literals->empty()) {
+        frame.next = frame.end;
+    } else {
+        current = std::string_view(literals->front());
+    }
+}
+
+void PlanRenderer::callHelper(size_t index, OutputSink *capture, OutputSink &output) {
+    const PlanCall &call = plan.calls[index];
+    TraceSpan span("call", call.name);
+    if (fragments == nullptr) {
+        frames.push_back({
+            .begin = call.body.begin,
+            .next = call.body.begin,
+            .end = call.body.end,
+            .variables = call.variables,
+            .capture = capture,
+            .span = std::move(span),
+        });
+        return;
+    }
+    std::optional<std::string> &fragment = fragments->fragments[index];
+    if (fragment) {
+        fragments->hits++;
+        (capture != nullptr ? *capture : output) << *fragment;
+        return;
+    }
+    fragments->misses++;
+    auto buffer = std::make_unique<OutputSink>();
+    OutputSink *bufferPointer = buffer.get();
+    frames.push_back({
+        .begin = call.body.begin,
+        .next = call.body.begin,
+        .end = call.body.end,
+        .variables = call.variables,
+        .capture = bufferPointer,
+        .call = index,
+        .fragment = std::move(buffer),
+        .span = std::move(span),
+    });
+}
+
+void PlanRenderer::finish(OutputSink &output) {
+    Frame &frame = frames.back();
+    if (frame.literals != nullptr && ++frame.iteration < frame.literals->size()) {
+        *frame.current = std::string_view((*frame.literals)[frame.iteration]);
+        frame.next = frame.begin;
+        return;
+    }
+    if (frame.fragment) {
+        std::optional<std::string> &fragment = fragments->fragments[frame.call];
+        fragment = frame.fragment->take();
+        // the frame below is the one that made the call
+        OutputSink *capture = frames.size() > 1 ? frames[frames.size() - 2].capture : nullptr;
+        (capture != nullptr ? *capture : output) << *fragment;
+    }
+    frames.pop_back();
+}
+
+ThreadPool &renderPool() {
+    static ThreadPool pool(ThreadPool::defaultThreadCount());
+    return pool;
+}
+
+namespace {
+
+// root blocks with fewer instructions aren't worth splitting
+constexpr size_t PARALLEL_MIN_INSTRUCTIONS = 1024;
+constexpr size_t SEGMENT_MIN_INSTRUCTIONS = 128;
+// more segments than threads, so calls of different sizes even out
+constexpr size_t SEGMENTS_PER_THREAD = 8;
+
+// A root block split into contiguous segments. The calling thread and the pool's helpers claim them
+// in order, the caller writes the finished ones in order. The indentation is part of the plan's text,
+// so the segments splice without adjustments. Helpers that start after everything was claimed return
+// without touching the plan, which may be gone by then, and a failed render waits for the claimed ones.
+struct ParallelRender {
+    struct Segment {
+        PlanBlock block;
+        std::string output;
+        std::vector<PLCLToWeb::Diagnostic> diagnostics;
+        std::exception_ptr exception;
+        size_t hits = 0;
+        size_t misses = 0;
+        bool done = false;
+    };
+
+    const RenderPlan *plan;
+    bool fragmentCache;
+    std::vector<Segment> segments;
+    // the allocations of every segment count for the thread the render is for
+    AllocationTracker *tracker = AllocationTracker::active();
+    std::atomic<size_t> next = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // renders segments until none are left, or just one if once is set, returns false once none are left
+    bool work(std::optional<FragmentCache> &fragments, bool once) {
+        size_t index;
+        while ((index = next.fetch_add(1)) < segments.size()) {
+            Segment &segment = segments[index];
+            {
+                // the tracker is only safe to use until the segment is done
+                AllocationScope allocations(tracker);
+                TraceSpan span("segment", "segment", index);
+                try {
+                    DiagnosticsCollect collect(segment.diagnostics);
+                    if (fragmentCache && !fragments) {
+                        fragments.emplace();
+                    }
+                    size_t hits = fragments ? fragments->hits : 0;
+                    size_t misses = fragments ? fragments->misses : 0;
+                    OutputSink output;
+                    PlanRenderer(*plan, segment.block, fragments ? &*fragments : nullptr).resume(output);
+                    segment.output = output.take();
+                    if (fragments) {
+                        segment.hits = fragments->hits - hits;
+                        segment.misses = fragments->misses - misses;
+                    }
+                } catch (...) {
+                    segment.exception = std::current_exception();
+                }
+            }
+            {
+                std::lock_guard lock(mutex);
+                segment.done = true;
+            }
+            finished.notify_all();
+            if (once) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void helper() {
+        std::optional<FragmentCache> fragments;
+        work(fragments, false);
+    }
+
+    // writes the finished segments starting at written, waits for them if wait is set
+    size_t write(size_t written, bool wait, OutputSink &output, FragmentCache *fragments) {
+        for (; written < segments.size(); written++) {
+            Segment &segment = segments[written];
+            {
+                std::unique_lock lock(mutex);
+                if (wait) {
+                    finished.wait(lock, [&segment] { return segment.done; });
+                } else if (!segment.done) {
+                    break;
+                }
+            }
+            // reported again on the calling thread, so they end up where its own ones do
+            for (auto &diagnostic : segment.diagnostics) {
+                report(std::move(diagnostic));
+            }
+            if (segment.exception) {
+                std::rethrow_exception(segment.exception);
+            }
+            output << segment.output;
+            std::string().swap(segment.output);
+            if (fragments != nullptr) {
+                fragments->hits += segment.hits;
+                fragments->misses += segment.misses;
+            }
+        }
+        return written;
+    }
+
+    // stops handing out segments and waits for the claimed ones, so nothing uses the plan afterwards
+    void cancel() {
+        size_t claimed = std::min(next.exchange(segments.size()), segments.size());
+        std::unique_lock lock(mutex);
+        for (size_t i = 0; i < claimed; i++) {
+            finished.wait(lock, [&segment = segments[i]] { return segment.done; });
+        }
+    }
+};
+
+}
+
+void renderPlan(const RenderPlan &plan, OutputSink &output, FragmentCache *fragments, size_t threads) {
+    size_t count = plan.root.end - plan.root.begin;
+    if (threads <= 1 || count < PARALLEL_MIN_INSTRUCTIONS) {
+        PlanRenderer(plan, fragments).resume(output);
+        return;
+    }
+    auto state = std::make_shared<ParallelRender>();
+    state->plan = &plan;
+    state->fragmentCache = fragments != nullptr;
+    size_t segments = std::min(threads * SEGMENTS_PER_THREAD, count / SEGMENT_MIN_INSTRUCTIONS);
+    state->segments.resize(segments);
+    for (size_t i = 0; i < segments; i++) {
+        state->segments[i].block = {plan.root.begin + count * i / segments, plan.root.begin + count * (i + 1) / segments};
+    }
+    // a failed segment or output ends the render early, the helpers may not go on using the plan
+    try {
+        for (size_t i = 1; i < threads; i++) {
+            renderPool().submit([state] { state->helper(); });
+        }
+        // the caller renders too, so a busy pool only makes it slower, it can't deadlock
+        std::optional<FragmentCache> own;
+        size_t written = 0;
+        while (state->work(own, true)) {
+            written = state->write(written, false, output, fragments);
+        }
+        state->write(written, true, output, fragments);
+    } catch (...) {
+        state->cancel();
+        throw;
+    }
+}
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "HTML.hpp"
+#include "Sink.hpp"
+#include "Trace.hpp"
+
+// A P(L)CLHTML document lowered into a flat instruction stream. Everything that doesn't depend on
+// variable values is resolved while compiling, so rendering mostly copies pre-concatenated text and
+// only bindings, loops and template calls need any work.
+enum class PlanOp : uint8_t {
+    TEXT,       // copies length bytes of the text pool, starting at index, longer runs take several
+    BINDING,    // a _Text binding, index into bindings
+    LOOP,       // a _BindingLoop, index into loops
+    CALL,       // a template instantiation, index into calls
+    ATTRIBUTES, // the attributes of an element with _Bindings, index into attributes
+};
+
+struct PlanInstruction {
+    PlanOp op;
+    uint32_t length;
+    size_t index;
+};
+
+// a contiguous range of instructions
+struct PlanBlock {
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+struct PlanBinding {
+    std::string source;
+    std::string name;
+    // bound by a _RawHTML element, the value is written without escaping
+    bool raw;
+};
+
+struct PlanLoop {
+    std::string source;
+    std::string name;
+    PlanBlock body;
+};
+
+struct PlanCall {
+    // the instantiating element's type
+    std::string name;
+    const VariableScope *variables;
+    PlanBlock body;
+};
+
+struct PlanAttributeBinding {
+    std::string source;
+    // index of the element's own attribute, otherwise the slot of an added attribute past them
+    uint32_t target;
+    // the attribute name used if the binding adds the attribute
+    std::string targetName;
+};
+
+struct PlanAttributes {
+    std::string name;
+    // every own attribute as it's rendered when not bound, including the leading space
+    std::vector<std::string> rendered;
+    std::vector<std::string> names;
+    std::vector<PlanAttributeBinding> bindings;
+};
+
+struct RenderPlan {
+    std::vector<PlanInstruction> instructions;
+    std::string text;
+    std::vector<PlanBinding> bindings;
+    std::vector<PlanLoop> loops;
+    std::vector<PlanCall> calls;
+    std::vector<PlanAttributes> attributes;
+    // the variables of every template instantiation, the calls point into it
+    std::vector<std::unique_ptr<VariableScope>> scopes;
+    PlanBlock root;
+    // template instantiations in the document, including the ones inlined as text
+    size_t instantiations = 0;
+};
+
+// The output of template calls while rendering one plan. A call's output only depends on its
+// variables, so calls rendered again, by a loop or an identical instantiation, become a copy.
+// Diagnostics of a call are only reported the first time it's rendered.
+struct FragmentCache {
+    // by call index
+    std::vector<std::optional<std::string>> fragments;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// Renders a plan with an explicit stack of frames instead of recursing into loops and calls, so their
+// nesting is only bounded by the heap and rendering can stop between instructions and continue later.
+// The plan and the fragment cache have to outlive the renderer.
+class PlanRenderer {
+public:
+    // fragments may be nullptr to render every call in place
+    explicit PlanRenderer(const RenderPlan &plan, FragmentCache *fragments = nullptr);
+    // renders a range of the root block, the variables of the root are empty
+    PlanRenderer(const RenderPlan &plan, PlanBlock block, FragmentCache *fragments = nullptr);
+
+    // renders until at least budget bytes were written to output or the plan is done, returns whether
+    // it's done. Calls rendered into the fragment cache only count once they're copied to the output.
+    bool resume(OutputSink &output, size_t budget = SIZE_MAX);
+
+    [[nodiscard]] bool done() const {
+        return frames.empty();
+    }
+
+private:
+    // a block being rendered, every loop iteration and call gets one. Every member has a default,
+    // the designated initializers only name the ones a kind of frame uses
+    struct Frame {
+        size_t begin = 0;
+        size_t next = 0;
+        size_t end = 0;
+        const VariableScope *variables = nullptr;
+        // the innermost fragment being rendered, nullptr to write to the output
+        OutputSink *capture = nullptr;
+        // loops: their own scope, the literal it currently holds and the literals to iterate
+        std::unique_ptr<VariableScope> loopVariables{};
+        VariableValue *current = nullptr;
+        const LiteralArray *literals = nullptr;
+        size_t iteration = 0;
+        // calls rendered into the fragment cache: the call and the buffer collecting the fragment
+        size_t call = 0;
+        std::unique_ptr<OutputSink> fragment{};
+        TraceSpan span{};
+    };
+
+    // both push frames, so they get copies of what they need from the current one
+    void loopHelper(const PlanLoop &loop, const VariableScope *variables, OutputSink *capture);
+    void callHelper(size_t index, OutputSink *capture, OutputSink &output);
+    // the block of the top frame is done, moves to the next iteration or pops it
+    void finish(OutputSink &output);
+
+    const RenderPlan &plan;
+    FragmentCache *fragments;
+    std::vector<Frame> frames;
+};
+
+class ThreadPool;
+
+// shared by every compile and render that splits its work, sized to the hardware
+ThreadPool &renderPool();
+
+// the plan refers to the parsed trees, they have to outlive it
+// With more than one thread, the sibling subtrees of large lists of the document are lowered on the
+// render pool and spliced in order. The output is the same, identical instantiations in different
+// subtrees only don't share a call.
+RenderPlan compileHTML(const Config::ConfigRoot &input, bool minify, size_t indent, const std::vector<const TemplateRegistry*> &imports, size_t threads = 1);
+// fragments may be nullptr to render every call in place
+// With more than one thread, large root blocks are split into segments rendered on the render pool
+// and written in order. Every thread keeps a fragment cache of its own then, fragments only gets
+// their hits and misses.
+void renderPlan(const RenderPlan &plan, OutputSink &output, FragmentCache *fragments = nullptr, size_t threads = 1);
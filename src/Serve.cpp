@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "Serve.hpp"
+
+#ifdef SERVE_SUPPORTED
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <libPLCLToWeb.hpp>
+
+#include "Build.hpp"
+#include "Generic.hpp"
+#include "InputFile.hpp"
+#include "Libraries.hpp"
+#include "OutputFile.hpp"
+#include "ServeProtocol.hpp"
+#include "Watch.hpp"
+
+namespace {
+
+struct Compiled {
+    bool success;
+    std::vector<PLCLToWeb::Diagnostic> diagnostics;
+    std::string output;
+};
+
+bool sameOptions(const PLCLToWeb::Options &a, const PLCLToWeb::Options &b) {
+    return a.minify == b.minify && a.indent == b.indent && a.emitCpp == b.emitCpp;
+}
+
+// compiled files, kept until the file or one of the libraries it imports changes
+class ResidentDocuments {
+public:
+    [[nodiscard]] std::shared_ptr<const Compiled> find(const std::filesystem::path &file, const PLCLToWeb::Options &options) const {
+        std::lock_guard lock(mutex);
+        auto it = entries.find(file);
+        if (it == entries.end()) {
+            return nullptr;
+        }
+        for (const auto &[entryOptions, compiled] : it->second) {
+            if (sameOptions(entryOptions, options)) {
+                return compiled;
+            }
+        }
+        return nullptr;
+    }
+
+    // the watch picks the file up with its next callback
+    void request(const std::filesystem::path &file) {
+        std::lock_guard lock(mutex);
+        if (requestedSet.insert(file).second) {
+            requested.push_back(file);
+        }
+    }
+
+    // taken once the file is watched and before reading it, changes since then make store drop the output
+    [[nodiscard]] uint64_t generation() const {
+        std::lock_guard lock(mutex);
+        return currentGeneration;
+    }
+
+    void store(const std::filesystem::path &file, const PLCLToWeb::Options &options, std::shared_ptr<const Compiled> compiled, uint64_t generation) {
+        std::lock_guard lock(mutex);
+        if (enabled && generation == currentGeneration) {
+            entries[file].emplace_back(options, std::move(compiled));
+        }
+    }
+
+    // called by the watch, returns the files to watch from now on
+    std::vector<std::filesystem::path> invalidate(const std::vector<std::filesystem::path> &changed) {
+        std::lock_guard lock(mutex);
+        if (!changed.empty()) {
+            currentGeneration++;
+            for (const auto &file : invalidateChanged(changed, requested)) {
+                entries.erase(file);
+            }
+        }
+        return watchedFiles(requested);
+    }
+
+    // without a watch there's no telling when the outputs get stale
+    void disable() {
+        std::lock_guard lock(mutex);
+        enabled = false;
+        entries.clear();
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::filesystem::path, std::vector<std::pair<PLCLToWeb::Options, std::shared_ptr<const Compiled>>>, PathHash> entries;
+    // every file that was requested, in request order
+    std::vector<std::filesystem::path> requested;
+    std::unordered_set<std::filesystem::path, PathHash> requestedSet;
+    uint64_t currentGeneration = 0;
+    bool enabled = true;
+};
+
+struct Server {
+    PLCLToWeb::Options defaults;
+    bool fsync = false;
+    ResidentDocuments documents;
+    WatchControl control;
+};
+
+// buffered reading and writing on a client socket, which Clients closes
+class Connection {
+public:
+    static constexpr size_t MAX_LINE_LENGTH = 64 * 1024;
+
+    explicit Connection(int fd) : fd(fd) {}
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    // all of these return false once the client is gone
+    bool readLine(std::string &line) {
+        while (true) {
+            size_t end = buffer.find('\n', position);
+            if (end != std::string::npos) {
+                line.assign(buffer, position, end - position);
+                if (line.ends_with('\r')) {
+                    line.pop_back();
+                }
+                position = end + 1;
+                return true;
+            }
+            if (buffer.size() - position > MAX_LINE_LENGTH || !fill()) {
+                return false;
+            }
+        }
+    }
+
+    bool read(size_t size, std::string &data) {
+        while (buffer.size() - position < size) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        data.assign(buffer, position, size);
+        position += size;
+        return true;
+    }
+
+    bool write(std::string_view data) {
+        while (!data.empty()) {
+            // MSG_NOSIGNAL keeps a client that went away from killing the daemon with SIGPIPE
+            ssize_t written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+private:
+    bool fill() {
+        buffer.erase(0, position);
+        position = 0;
+        char chunk[64 * 1024];
+        while (true) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received > 0) {
+                buffer.append(chunk, received);
+                return true;
+            }
+            if (received == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+    }
+
+    int fd;
+    std::string buffer;
+    size_t position = 0;
+};
+
+// The libraries a file imports are only known once it's compiled, so they may have been read before
+// the watch covered them. Once it does, the ones written since the compile started are dropped.
+// Returns false if any was, the output may have used its old content.
+bool librariesSettled(Server &server, const std::filesystem::path &file, std::filesystem::file_time_type started) {
+    if (!server.control.sync()) {
+        return false;
+    }
+    // modification times come from a coarser clock, the margin keeps a write right after the start from looking older
+    started -= std::chrono::seconds(1);
+    bool settled = true;
+    for (const auto &library : templateLibraries().dependencies(file)) {
+        std::error_code ec;
+        std::filesystem::file_time_type modified = std::filesystem::last_write_time(library, ec);
+        if (ec || modified >= started) {
+            templateLibraries().invalidate(library);
+            settled = false;
+        }
+    }
+    return settled;
+}
+
+std::shared_ptr<const Compiled> compileFile(Server &server, const std::filesystem::path &file, PLCLToWeb::Language language, PLCLToWeb::Options options) {
+    if (std::shared_ptr<const Compiled> compiled = server.documents.find(file, options)) {
+        return compiled;
+    }
+    // a change between reading the file and watching it would leave the output stale for good
+    server.documents.request(file);
+    bool watched = server.control.sync();
+    uint64_t generation = server.documents.generation();
+    std::filesystem::file_time_type started = std::filesystem::file_time_type::clock::now();
+    std::optional<InputFile> input = InputFile::read(file);
+    if (!input) {
+        return std::make_shared<const Compiled>(false, std::vector<PLCLToWeb::Diagnostic>{{"", "Failed to open " + file.string()}}, "");
+    }
+    options.path = file;
+    auto compiled = std::make_shared<Compiled>();
+    PLCLToWeb::Result result = PLCLToWeb::compile(input->view(), language, options, compiled->output);
+    compiled->success = result.success;
+    compiled->diagnostics = std::move(result.diagnostics);
+    if (watched && librariesSettled(server, file, started)) {
+        server.documents.store(file, options, compiled, generation);
+    }
+    return compiled;
+}
+
+// answers a request whose header has been read, returns false once the client is gone
+bool handleRequest(Server &server, Connection &connection, Request &request, const std::string &error) {
+    if (request.sourceLength && *request.sourceLength > MAX_SOURCE_LENGTH) {
+        connection.write(errorResponse("Source-Length is larger than " + std::to_string(MAX_SOURCE_LENGTH) + " bytes"));
+        return false;
+    }
+    std::string source;
+    if (request.sourceLength && !connection.read(*request.sourceLength, source)) {
+        return false;
+    }
+    std::string message = error;
+    if (message.empty() && request.file.empty() == !request.sourceLength) {
+        message = "Expected either File or Source-Length";
+    } else if (message.empty() && request.sourceLength && !request.language) {
+        message = "Source-Length needs Language";
+    } else if (message.empty() && !request.file.empty() && !PLCLToWeb::languageOf(request.file)) {
+        message = "Unknown extension " + request.file.extension().string();
+    } else if (message.empty() && !request.output.empty() && request.file.empty()) {
+        message = "Output only works with File";
+    }
+    if (!message.empty()) {
+        return connection.write(errorResponse(message));
+    }
+
+    if (request.sourceLength) {
+        Compiled compiled;
+        std::filesystem::file_time_type started = std::filesystem::file_time_type::clock::now();
+        PLCLToWeb::Result result = PLCLToWeb::compile(source, *request.language, request.options, compiled.output);
+        // nothing is kept but the libraries it imported, which later files share
+        if (!request.options.path.empty()) {
+            librariesSettled(server, request.options.path, started);
+        }
+        return connection.write(response(result.success ? "ok" : "failed", result.diagnostics, compiled.output.size())) &&
+               connection.write(compiled.output);
+    }
+    std::shared_ptr<const Compiled> compiled = compileFile(server, request.file, *PLCLToWeb::languageOf(request.file), request.options);
+    if (request.output.empty()) {
+        return connection.write(response(compiled->success ? "ok" : "failed", compiled->diagnostics, compiled->output.size())) &&
+               connection.write(compiled->output);
+    }
+    std::vector<PLCLToWeb::Diagnostic> diagnostics = compiled->diagnostics;
+    bool success = compiled->success;
+    std::filesystem::path output = *outputFile(request.file, request.output, request.options.emitCpp);
+    std::error_code ec;
+    std::filesystem::create_directories(request.output, ec);
+    // the client may read the file as soon as it has the response, a failed compile keeps the previous one
+    OutputFile file(output, server.fsync);
+    if (success && (!file.write(compiled->output) || !file.commit())) {
+        diagnostics.push_back({"", "Failed to open " + output.string() + " for writing"});
+        success = false;
+    }
+    return connection.write(response(success ? "ok" : "failed", diagnostics, 0));
+}
+
+void serveClient(int fd, Server &server) {
+    Connection connection(fd);
+    std::string line;
+    while (true) {
+        Request request;
+        request.options = server.defaults;
+        std::string error;
+        bool started = false;
+        while (true) {
+            if (!connection.readLine(line)) {
+                return;
+            }
+            if (line.empty()) {
+                // blank lines between requests are ignored
+                if (started) {
+                    break;
+                }
+                continue;
+            }
+            started = true;
+            if (error.empty()) {
+                error = parseHeader(line, request);
+            }
+        }
+        if (!handleRequest(server, connection, request, error)) {
+            return;
+        }
+    }
+}
+
+// A thread per client, at most MAX_CLIENTS at a time, further connections wait in the listen backlog.
+// Owns the client sockets, so stop can end the connections without hitting a reused descriptor.
+class Clients {
+public:
+    static constexpr size_t MAX_CLIENTS = 64;
+
+    explicit Clients(Server &server) : server(server) {}
+    Clients(const Clients &) = delete;
+    Clients &operator=(const Clients &) = delete;
+    ~Clients() {
+        stop();
+    }
+
+    // waits for a free slot
+    void start(int fd) {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this] { return running.size() < MAX_CLIENTS; });
+        joinFinished();
+        uint64_t id = nextId++;
+        // the thread can't finish before it's in running, finish needs the lock
+        running.emplace(id, std::pair(fd, std::thread([this, id, fd] {
+            serveClient(fd, server);
+            finish(id);
+        })));
+    }
+
+    // ends every connection once its current request is answered and joins the threads
+    void stop() {
+        std::unique_lock lock(mutex);
+        for (const auto &[id, client] : running) {
+            shutdown(client.first, SHUT_RDWR);
+        }
+        changed.wait(lock, [this] { return running.empty(); });
+        joinFinished();
+    }
+
+private:
+    void finish(uint64_t id) {
+        std::lock_guard lock(mutex);
+        auto it = running.find(id);
+        close(it->second.first);
+        finished.push_back(std::move(it->second.second));
+        running.erase(it);
+        changed.notify_all();
+    }
+
+    // the finished threads are past their last use of the lock
+    void joinFinished() {
+        for (auto &thread : finished) {
+            thread.join();
+        }
+        finished.clear();
+    }
+
+    Server &server;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::unordered_map<uint64_t, std::pair<int, std::thread>> running;
+    std::vector<std::thread> finished;
+    uint64_t nextId = 0;
+};
+
+}
+
+bool serve(const std::filesystem::path &socketPath, const Cli &cli, WatchControl *control) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::string pathString = socketPath.string();
+    if (pathString.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << socketPath << " is too long" << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, pathString.c_str(), pathString.size() + 1);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        std::cerr << "Failed to create a socket\n" << strerror(errno) << std::endl;
+        return false;
+    }
+    // a socket left behind by a previous run would make bind fail
+    std::error_code ec;
+    if (std::filesystem::is_socket(socketPath, ec)) {
+        std::filesystem::remove(socketPath, ec);
+    }
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1 || listen(listener, SOMAXCONN) == -1) {
+        std::cerr << "Failed to listen on " << socketPath << '\n' << strerror(errno) << std::endl;
+        close(listener);
+        return false;
+    }
+
+    Server server;
+    server.defaults = {!cli.dontMinify, cli.indent, cli.emitCpp, cli.fragmentCache, cli.renderThreads, {}};
+    server.fsync = cli.fsync;
+    std::thread watcher([&server, debounce = std::chrono::milliseconds(cli.debounce)] {
+        bool stopped = watchFiles({}, debounce, [&server](const std::vector<std::filesystem::path> &changed) {
+            return server.documents.invalidate(changed);
+        }, &server.control);
+        if (!stopped) {
+            std::cerr << "Stopped watching files, compiled files aren't kept in memory anymore" << std::endl;
+            server.documents.disable();
+            // releases the requests waiting for the watch
+            server.control.stop();
+        }
+    });
+    Clients clients(server);
+    std::cout << "Listening on " << pathString << std::endl;
+    // poll ignores the negative fd if there's no control
+    pollfd pfds[2] = {{listener, POLLIN, 0}, {control != nullptr ? control->handle() : -1, POLLIN, 0}};
+    bool stopped = false;
+    while (true) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Failed to wait for connections\n" << strerror(errno) << std::endl;
+            break;
+        }
+        if (pfds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(pfds[1].fd, &value, sizeof(value)) > 0) {}
+            if (control->stopped()) {
+                stopped = true;
+                break;
+            }
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "Failed to accept a connection\n" << strerror(errno) << std::endl;
+            break;
+        }
+        clients.start(client);
+    }
+    clients.stop();
+    server.control.stop();
+    watcher.join();
+    close(listener);
+    if (stopped) {
+        std::filesystem::remove(socketPath, ec);
+    }
+    return stopped;
+}
+#endif
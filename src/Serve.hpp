@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+
+#include "Cli.hpp"
+#include "Watch.hpp"
+
+#ifdef __linux__
+#define SERVE_SUPPORTED 1
+#endif
+
+// Serves compile requests on a Unix domain socket, one thread per client for up to 64 clients at a time.
+// Compiled files stay in memory until they or a template library they import change, which is
+// noticed the same way --watch does. The options of cli are the defaults for every request.
+//
+// A request is a header of "Name: value" lines ended by an empty line:
+//   File: <path>            compile a file
+//   Source-Length: <bytes>  compile the source following the header instead, needs Language, at most 256 MiB
+//   Language: html|css      the language of the source
+//   Path: <path>            where the source comes from, for resolving its _Imports
+//   Output: <directory>     write the output of a file there instead of sending it back
+//   Minify: yes|no, Indent: <size>, Emit-Cpp: yes|no
+// Every request gets a response in the same format, followed by the output:
+//   Status: ok|failed|error
+//   Diagnostic: <diagnostic> for every diagnostic, Error: <message> for malformed requests
+//   Length: <bytes>
+// A client can send any number of requests over one connection.
+// Returns true once the control is stopped and every connection is closed, false on failure.
+bool serve(const std::filesystem::path &socket, const Cli &cli, WatchControl *control = nullptr);
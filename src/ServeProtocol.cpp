@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+
+#include "ServeProtocol.hpp"
+#include "Generic.hpp"
+
+namespace {
+
+bool parseSize(std::string_view value, size_t &result) {
+    return std::from_chars(value.data(), value.data() + value.size(), result).ec == std::errc() && !value.empty();
+}
+
+bool parseBool(std::string_view value, bool &result) {
+    if (Generic::iequals(std::string(value), "yes")) {
+        result = true;
+    } else if (Generic::iequals(std::string(value), "no")) {
+        result = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}
+
+std::string parseHeader(std::string_view line, Request &request) {
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        return "Expected \"Name: value\", got " + std::string(line);
+    }
+    std::string name(line.substr(0, colon));
+    std::string_view value = line.substr(colon + 1);
+    while (value.starts_with(' ')) {
+        value.remove_prefix(1);
+    }
+    if (Generic::iequals(name, "File")) {
+        request.file = std::filesystem::absolute(value).lexically_normal();
+    } else if (Generic::iequals(name, "Source-Length")) {
+        size_t length;
+        if (!parseSize(value, length)) {
+            return "Expected a size after Source-Length";
+        }
+        request.sourceLength = length;
+    } else if (Generic::iequals(name, "Language")) {
+        if (Generic::iequals(std::string(value), "html")) {
+            request.language = PLCLToWeb::Language::HTML;
+        } else if (Generic::iequals(std::string(value), "css")) {
+            request.language = PLCLToWeb::Language::CSS;
+        } else {
+            return "Expected html or css after Language";
+        }
+    } else if (Generic::iequals(name, "Path")) {
+        request.options.path = std::filesystem::absolute(value).lexically_normal();
+    } else if (Generic::iequals(name, "Output")) {
+        request.output = std::filesystem::absolute(value).lexically_normal();
+    } else if (Generic::iequals(name, "Minify")) {
+        if (!parseBool(value, request.options.minify)) {
+            return "Expected yes or no after Minify";
+        }
+    } else if (Generic::iequals(name, "Indent")) {
+        if (!parseSize(value, request.options.indent)) {
+            return "Expected a size after Indent";
+        }
+    } else if (Generic::iequals(name, "Emit-Cpp")) {
+        if (!parseBool(value, request.options.emitCpp)) {
+            return "Expected yes or no after Emit-Cpp";
+        }
+    } else {
+        return "Unknown header " + name;
+    }
+    return "";
+}
+
+std::string response(std::string_view status, const std::vector<PLCLToWeb::Diagnostic> &diagnostics, size_t length) {
+    std::ostringstream stream;
+    stream << "Status: " << status << '\n';
+    for (const auto &diagnostic : diagnostics) {
+        std::ostringstream line;
+        line << diagnostic;
+        std::string text = std::move(line).str();
+        std::ranges::replace(text, '\n', ' ');
+        stream << "Diagnostic: " << text << '\n';
+    }
+    stream << "Length: " << length << "\n\n";
+    return std::move(stream).str();
+}
+
+std::string errorResponse(std::string message) {
+    std::ranges::replace(message, '\n', ' ');
+    return "Status: error\nError: " + message + "\nLength: 0\n\n";
+}
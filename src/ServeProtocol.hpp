@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libPLCLToWeb.hpp>
+
+// The header lines of --serve requests and responses, described in Serve.hpp.
+// Kept apart from the sockets so it builds on every platform.
+
+struct Request {
+    std::filesystem::path file;
+    std::optional<size_t> sourceLength;
+    std::optional<PLCLToWeb::Language> language;
+    std::filesystem::path output;
+    PLCLToWeb::Options options;
+};
+
+// a source can't be skipped without reading it, so a longer one ends the connection
+constexpr size_t MAX_SOURCE_LENGTH = 256 * 1024 * 1024;
+
+// returns an error message if the line isn't a valid header
+std::string parseHeader(std::string_view line, Request &request);
+// the header of a response, the output of length bytes follows it
+std::string response(std::string_view status, const std::vector<PLCLToWeb::Diagnostic> &diagnostics, size_t length);
+// the response to a malformed request
+std::string errorResponse(std::string message);
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Output sink passed down the renderers, so nested elements append to the same buffer
+// instead of returning strings that get copied into their parents.
+// Without a consumer the buffer simply grows, with one it gets drained once it's past the threshold.
+class OutputSink {
+public:
+    static constexpr size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+    typedef std::function<void(std::string_view)> Consumer;
+
+    OutputSink() = default;
+    explicit OutputSink(Consumer consumer, size_t flushThreshold = DEFAULT_FLUSH_THRESHOLD)
+        : consumer(std::move(consumer)), flushThreshold(flushThreshold) {
+        buffer.reserve(flushThreshold);
+    }
+    explicit OutputSink(std::ostream &stream, size_t flushThreshold = DEFAULT_FLUSH_THRESHOLD)
+        : OutputSink([&stream](std::string_view text) {
+            stream.write(text.data(), static_cast<std::streamsize>(text.size()));
+        }, flushThreshold) {}
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+    ~OutputSink() {
+        flush();
+    }
+
+    void append(std::string_view text) {
+        buffer.append(text);
+        maybeFlush();
+    }
+
+    void append(char character) {
+        buffer.push_back(character);
+        maybeFlush();
+    }
+
+    void appendIndent(size_t count) {
+        buffer.append(count, ' ');
+        maybeFlush();
+    }
+
+    OutputSink &operator<<(std::string_view text) {
+        append(text);
+        return *this;
+    }
+
+    OutputSink &operator<<(char character) {
+        append(character);
+        return *this;
+    }
+
+    // total amount of bytes written, including the ones already flushed
+    [[nodiscard]] size_t size() const {
+        return flushed + buffer.size();
+    }
+
+    void flush() {
+        if (!consumer || buffer.empty()) {
+            return;
+        }
+        consumer(buffer);
+        flushed += buffer.size();
+        buffer.clear();
+    }
+
+    // only meaningful for sinks without a consumer
+    [[nodiscard]] std::string take() {
+        return std::move(buffer);
+    }
+
+private:
+    void maybeFlush() {
+        if (consumer && buffer.size() >= flushThreshold) {
+            flush();
+        }
+    }
+
+    std::string buffer;
+    Consumer consumer;
+    size_t flushThreshold = DEFAULT_FLUSH_THRESHOLD;
+    size_t flushed = 0;
+};
@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "Stats.hpp"
+#include "Allocations.hpp"
+#include "Diagnostics.hpp"
+
+namespace {
+
+std::string formatTime(std::chrono::nanoseconds time) {
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(2) << std::chrono::duration<double, std::milli>(time).count();
+    return stream.str();
+}
+
+std::string formatBytes(size_t bytes) {
+    if (bytes < 1024) {
+        return std::to_string(bytes) + " B";
+    }
+    std::ostringstream stream;
+    stream << std::fixed << std::setprecision(1);
+    if (bytes < 1024 * 1024) {
+        stream << static_cast<double>(bytes) / 1024 << " KiB";
+    } else {
+        stream << static_cast<double>(bytes) / (1024 * 1024) << " MiB";
+    }
+    return stream.str();
+}
+
+std::vector<std::string> row(const std::string &name, const FileStatistics &statistics, bool fragmentCache) {
+    const PLCLToWeb::Statistics &compile = statistics.compile;
+    std::vector<std::string> result = {
+        name,
+        formatTime(statistics.read),
+        formatTime(compile.parse),
+        formatTime(compile.imports),
+        formatTime(compile.render),
+        formatTime(compile.write),
+        formatBytes(compile.bytesIn),
+        formatBytes(compile.bytesOut),
+        std::to_string(compile.elements),
+        std::to_string(compile.attributes),
+        std::to_string(compile.templateInstantiations),
+        std::to_string(statistics.allocations),
+#ifdef ALLOCATION_BYTES_SUPPORTED
+        formatBytes(statistics.peakBytes),
+#else
+        "-",
+#endif
+    };
+    if (fragmentCache) {
+        result.push_back(std::to_string(compile.fragmentCacheHits));
+        result.push_back(std::to_string(compile.fragmentCacheMisses));
+    }
+    return result;
+}
+
+void writeJsonString(std::ostream &stream, std::string_view text) {
+    stream << '"';
+    for (char character : text) {
+        switch (character) {
+            case '"': stream << "\\\""; break;
+            case '\\': stream << "\\\\"; break;
+            case '\n': stream << "\\n"; break;
+            case '\r': stream << "\\r"; break;
+            case '\t': stream << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(character) < 0x20) {
+                    stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec << std::setfill(' ');
+                } else {
+                    stream << character;
+                }
+        }
+    }
+    stream << '"';
+}
+
+void writeJsonObject(std::ostream &stream, const FileStatistics &statistics) {
+    const PLCLToWeb::Statistics &compile = statistics.compile;
+    stream << "{\"upToDate\": " << (statistics.upToDate ? "true" : "false")
+           << ", \"readNs\": " << statistics.read.count()
+           << ", \"parseNs\": " << compile.parse.count()
+           << ", \"importsNs\": " << compile.imports.count()
+           << ", \"renderNs\": " << compile.render.count()
+           << ", \"writeNs\": " << compile.write.count()
+           << ", \"bytesIn\": " << compile.bytesIn
+           << ", \"bytesOut\": " << compile.bytesOut
+           << ", \"elements\": " << compile.elements
+           << ", \"attributes\": " << compile.attributes
+           << ", \"templateInstantiations\": " << compile.templateInstantiations
+           << ", \"fragmentCacheHits\": " << compile.fragmentCacheHits
+           << ", \"fragmentCacheMisses\": " << compile.fragmentCacheMisses
+           << ", \"allocations\": " << statistics.allocations
+           << ", \"peakBytes\": ";
+#ifdef ALLOCATION_BYTES_SUPPORTED
+    stream << statistics.peakBytes;
+#else
+    stream << "null";
+#endif
+    stream << "}";
+}
+
+FileStatistics total(const std::vector<FileStatistics> &files) {
+    FileStatistics result;
+    for (const auto &file : files) {
+        result.read += file.read;
+        result.compile += file.compile;
+        result.allocations += file.allocations;
+        // files are compiled one after another on each thread, so their peaks don't add up
+        result.peakBytes = std::max(result.peakBytes, file.peakBytes);
+    }
+    return result;
+}
+
+}
+
+void printStatistics(const std::vector<FileStatistics> &files, bool fragmentCache, std::ostream &stream) {
+    std::vector<std::vector<std::string>> rows;
+    rows.push_back({"File", "Read ms", "Parse ms", "Imports ms", "Render ms", "Write ms", "In", "Out", "Elements", "Attributes", "Templates", "Allocations", "Peak"});
+    if (fragmentCache) {
+        rows.back().push_back("Fragment hits");
+        rows.back().push_back("Fragment misses");
+    }
+    for (const auto &file : files) {
+        rows.push_back(row(file.file.string() + (file.upToDate ? " (up to date)" : ""), file, fragmentCache));
+    }
+    rows.push_back(row("Total", total(files), fragmentCache));
+
+    std::vector<size_t> widths(rows.front().size(), 0);
+    for (const auto &cells : rows) {
+        for (size_t i = 0; i < cells.size(); i++) {
+            widths[i] = std::max(widths[i], cells[i].size());
+        }
+    }
+    for (const auto &cells : rows) {
+        // the file names are left-aligned, the numbers right-aligned
+        stream << std::left << std::setw(static_cast<int>(widths[0])) << cells[0] << std::right;
+        for (size_t i = 1; i < cells.size(); i++) {
+            stream << "  " << std::setw(static_cast<int>(widths[i])) << cells[i];
+        }
+        stream << '\n';
+    }
+    stream << std::flush;
+}
+
+bool writeStatisticsJson(const std::vector<FileStatistics> &files, const std::filesystem::path &output) {
+    std::ofstream stream(output);
+    if (!stream) {
+        diagnostics() << "Failed to open " << output.string() << " for writing" << std::endl;
+        return false;
+    }
+    stream << "{\n  \"files\": [\n";
+    for (size_t i = 0; i < files.size(); i++) {
+        stream << "    {\"file\": ";
+        writeJsonString(stream, files[i].file.string());
+        stream << ", \"statistics\": ";
+        writeJsonObject(stream, files[i]);
+        stream << (i + 1 < files.size() ? "},\n" : "}\n");
+    }
+    stream << "  ],\n  \"total\": ";
+    writeJsonObject(stream, total(files));
+    stream << "\n}\n";
+    return static_cast<bool>(stream);
+}
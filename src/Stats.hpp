@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <ostream>
+#include <vector>
+#include <libPLCLToWeb.hpp>
+
+struct FileStatistics {
+    std::filesystem::path file;
+    // the build cache said the output is up to date, the file was only read
+    bool upToDate = false;
+    std::chrono::nanoseconds read{0};
+    PLCLToWeb::Statistics compile;
+    size_t allocations = 0;
+    size_t peakBytes = 0;
+};
+
+// one row per file and a total, the fragment cache columns are only shown if it was used
+void printStatistics(const std::vector<FileStatistics> &files, bool fragmentCache, std::ostream &stream);
+// the same as JSON, with times in nanoseconds and sizes in bytes
+bool writeStatisticsJson(const std::vector<FileStatistics> &files, const std::filesystem::path &output);
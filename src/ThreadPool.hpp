@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads pulling tasks from a shared FIFO queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    // finishes the queued tasks before joining the workers
+    ~ThreadPool();
+
+    template<typename Function>
+    auto submit(Function &&function) -> std::future<std::invoke_result_t<Function>> {
+        using Result = std::invoke_result_t<Function>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace_back([task] { (*task)(); });
+        }
+        condition.notify_one();
+        return future;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return workers.size();
+    }
+
+    // hardware concurrency, or 1 if it can't be determined
+    static size_t defaultThreadCount();
+
+private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+};
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <libPLCLToWeb.hpp>
+
+#include "Trace.hpp"
+
+std::atomic<bool> tracingEnabled = false;
+
+namespace {
+
+struct TraceEvent {
+    const char *category;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+// every thread records into its own buffer, the lock is only contended while writing the trace
+struct ThreadEvents {
+    std::mutex mutex;
+    size_t thread;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceState {
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point origin;
+    // kept alive after their threads exit, so pool threads don't take their spans with them
+    std::vector<std::shared_ptr<ThreadEvents>> threads;
+};
+
+TraceState &traceState() {
+    static TraceState state;
+    return state;
+}
+
+ThreadEvents &threadEvents() {
+    thread_local std::shared_ptr<ThreadEvents> events = [] {
+        auto result = std::make_shared<ThreadEvents>();
+        TraceState &state = traceState();
+        std::lock_guard lock(state.mutex);
+        result->thread = state.threads.size() + 1;
+        state.threads.push_back(result);
+        return result;
+    }();
+    return *events;
+}
+
+void writeJsonString(std::ostream &stream, std::string_view text) {
+    stream << '"';
+    for (char character : text) {
+        if (character == '"' || character == '\\') {
+            stream << '\\' << character;
+        } else if (static_cast<unsigned char>(character) < 0x20) {
+            stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec << std::setfill(' ');
+        } else {
+            stream << character;
+        }
+    }
+    stream << '"';
+}
+
+// Trace Event Format timestamps are in microseconds
+double microseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+void recordTraceEvent(const char *category, std::string name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    ThreadEvents &events = threadEvents();
+    std::lock_guard lock(events.mutex);
+    events.events.push_back({category, std::move(name), start, end});
+}
+
+namespace PLCLToWeb {
+    void startTracing() {
+        TraceState &state = traceState();
+        {
+            std::lock_guard lock(state.mutex);
+            state.origin = std::chrono::steady_clock::now();
+        }
+        tracingEnabled = true;
+    }
+
+    bool writeTrace(const std::filesystem::path &file) {
+        std::ofstream stream(file);
+        if (!stream) {
+            return false;
+        }
+        TraceState &state = traceState();
+        std::lock_guard lock(state.mutex);
+        stream << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto &thread : state.threads) {
+            std::lock_guard threadLock(thread->mutex);
+            stream << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->thread
+                   << ", \"args\": {\"name\": \"thread " << thread->thread << "\"}}";
+            first = false;
+            for (const auto &event : thread->events) {
+                stream << ",\n{\"name\": ";
+                writeJsonString(stream, event.name);
+                stream << ", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->thread
+                       << ", \"ts\": " << microseconds(event.start - state.origin) << ", \"dur\": " << microseconds(event.end - event.start) << "}";
+            }
+        }
+        stream << "\n]}\n";
+        return static_cast<bool>(stream);
+    }
+}
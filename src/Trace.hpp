@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// set by PLCLToWeb::startTracing
+extern std::atomic<bool> tracingEnabled;
+
+void recordTraceEvent(const char *category, std::string name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+// Records the time between its construction and destruction as a span on the current thread.
+// While tracing is disabled it costs a relaxed load and doesn't copy the name.
+class TraceSpan {
+public:
+    TraceSpan(const char *category, std::string_view name) {
+        if (tracingEnabled.load(std::memory_order_relaxed)) {
+            this->category = category;
+            this->name = name;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    // named "<name> <index>", formatted only while tracing
+    TraceSpan(const char *category, std::string_view name, size_t index) {
+        if (tracingEnabled.load(std::memory_order_relaxed)) {
+            this->category = category;
+            this->name.reserve(name.size() + 21);
+            this->name.append(name).append(" ").append(std::to_string(index));
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    // records nothing
+    TraceSpan() = default;
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+    // spans of the explicit-stack walkers live in their frames, which move when the stack grows
+    TraceSpan(TraceSpan &&other) noexcept
+        : category(std::exchange(other.category, nullptr)), name(std::move(other.name)), start(other.start) {}
+    ~TraceSpan() {
+        if (category != nullptr) {
+            recordTraceEvent(category, std::move(name), start, std::chrono::steady_clock::now());
+        }
+    }
+
+private:
+    const char *category = nullptr;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+};
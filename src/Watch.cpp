@@ -0,0 +1,501 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <csignal>
+#include <pthread.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#define WINDOWS_FORMAT_ERROR(buffer) \
+    FormatMessage( \
+        FORMAT_MESSAGE_FROM_SYSTEM | \
+        FORMAT_MESSAGE_ALLOCATE_BUFFER | \
+        FORMAT_MESSAGE_IGNORE_INSERTS, \
+        nullptr, \
+        GetLastError(), \
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), \
+        (LPTSTR)&buffer, \
+        0, \
+        nullptr \
+    );
+#endif
+
+#include "Generic.hpp"
+#include "Watch.hpp"
+
+namespace {
+// changes collected during the debounce window, kept in input order
+class PendingChanges {
+public:
+    explicit PendingChanges(const std::vector<std::filesystem::path> &files) {
+        setFiles(files);
+    }
+
+    // keeps the pending changes of the files that are still watched
+    void setFiles(const std::vector<std::filesystem::path> &newFiles) {
+        std::vector<std::filesystem::path> stillPending = take();
+        files = newFiles;
+        pending.assign(files.size(), false);
+        indices.clear();
+        indices.reserve(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            indices.emplace(files[i], i);
+        }
+        for (const auto &file : stillPending) {
+            auto it = indices.find(file);
+            if (it != indices.end() && !pending[it->second]) {
+                pending[it->second] = true;
+                count++;
+            }
+        }
+    }
+
+    [[nodiscard]] const std::vector<std::filesystem::path> &watched() const {
+        return files;
+    }
+
+    // returns false if the file isn't watched
+    bool add(const std::filesystem::path &file) {
+        auto it = indices.find(file);
+        if (it == indices.end()) {
+            return false;
+        }
+        if (!pending[it->second]) {
+            pending[it->second] = true;
+            count++;
+        }
+        lastChange = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return count == 0;
+    }
+
+    // time left until the debounce window is over
+    [[nodiscard]] std::chrono::milliseconds remaining(std::chrono::milliseconds debounce) const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastChange);
+        return elapsed >= debounce ? std::chrono::milliseconds(0) : debounce - elapsed;
+    }
+
+    std::vector<std::filesystem::path> take() {
+        std::vector<std::filesystem::path> changed;
+        changed.reserve(count);
+        for (size_t i = 0; i < files.size(); i++) {
+            if (pending[i]) {
+                changed.push_back(files[i]);
+                pending[i] = false;
+            }
+        }
+        count = 0;
+        return changed;
+    }
+
+private:
+    std::vector<std::filesystem::path> files;
+    std::unordered_map<std::filesystem::path, size_t, PathHash> indices;
+    std::vector<bool> pending;
+    size_t count = 0;
+    std::chrono::steady_clock::time_point lastChange;
+};
+}
+
+#ifdef __linux__
+WatchControl::WatchControl() : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd == -1) {
+        std::cerr << "Failed to create an eventfd\n" << strerror(errno) << std::endl;
+    }
+}
+
+WatchControl::~WatchControl() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+void WatchControl::wake() {
+    uint64_t value = 1;
+    if (fd != -1 && write(fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        std::cerr << "Failed to wake the watch\n" << strerror(errno) << std::endl;
+    }
+}
+
+bool watchFiles(const std::vector<std::filesystem::path> &files, std::chrono::milliseconds debounce, const WatchCallback &onChange, WatchControl *control) {
+    // non-blocking so the buffer can be drained after poll, the waiting itself is done by poll
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << "Failed to initialize inotify\n" << strerror(errno) << std::endl;
+        return false;
+    }
+    std::unordered_map<int, std::filesystem::path> parents;
+    std::unordered_map<std::filesystem::path, int, PathHash> watched;
+    auto addWatches = [&](const std::vector<std::filesystem::path> &newFiles) {
+        for (const auto &file : newFiles) {
+            std::filesystem::path parent = file.parent_path();
+            if (watched.contains(parent)) {
+                continue;
+            }
+            if (!std::filesystem::exists(parent)) {
+                std::cerr << "Parent path " << parent << " does not exist" << std::endl;
+                return false;
+            }
+            // editors that save through a temporary file and a rename don't cause IN_MODIFY
+            int wd = inotify_add_watch(fd, parent.c_str(), IN_MODIFY | IN_MOVED_TO);
+            if (wd == -1) {
+                std::cerr << "Failed to add watch\n" << strerror(errno) << std::endl;
+                return false;
+            }
+            parents.emplace(wd, parent);
+            watched.emplace(parent, wd);
+        }
+        return true;
+    };
+    if (!addWatches(files)) {
+        close(fd);
+        return false;
+    }
+
+    PendingChanges pending(files);
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    // poll ignores the negative fd if there's no control
+    pollfd pfds[2] = {{fd, POLLIN, 0}, {control != nullptr ? control->handle() : -1, POLLIN, 0}};
+    while (true) {
+        int timeout = pending.empty() ? -1 : static_cast<int>(pending.remaining(debounce).count());
+        int ready = poll(pfds, 2, timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Failed to wait for inotify events\n" << strerror(errno) << std::endl;
+            break;
+        }
+        if (ready == 0) {
+            pending.setFiles(onChange(pending.take()));
+            if (!addWatches(pending.watched())) {
+                break;
+            }
+            continue;
+        }
+        if (pfds[1].revents & POLLIN) {
+            uint64_t value;
+            while (read(pfds[1].fd, &value, sizeof(value)) > 0) {}
+            if (control->stopped()) {
+                close(fd);
+                return true;
+            }
+            uint64_t round = control->round();
+            pending.setFiles(onChange({}));
+            if (!addWatches(pending.watched())) {
+                break;
+            }
+            control->watching(round);
+        }
+        while (true) {
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len == -1) {
+                if (errno != EAGAIN) {
+                    std::cerr << "Failed to read inotify events\n" << strerror(errno) << std::endl;
+                    close(fd);
+                    return false;
+                }
+                break;
+            }
+            const struct inotify_event *event;
+            for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+                event = (const struct inotify_event *) ptr;
+                if (event->mask & IN_IGNORED) {
+                    std::cout << "File ignored" << std::endl;
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue;
+                }
+                auto parent = parents.find(event->wd);
+                if (parent != parents.end()) {
+                    pending.add(parent->second / event->name);
+                }
+            }
+        }
+        if (!pending.empty() && pending.remaining(debounce).count() == 0) {
+            pending.setFiles(onChange(pending.take()));
+            if (!addWatches(pending.watched())) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    return false;
+}
+#endif
+#ifdef _WIN32
+namespace {
+struct WatchedDirectory {
+    std::filesystem::path path;
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    OVERLAPPED overlapped{};
+    alignas(DWORD) uint8_t buffer[1024];
+};
+
+bool startReading(WatchedDirectory &directory) {
+    WINBOOL success = ReadDirectoryChangesW(directory.handle,
+                                            directory.buffer,
+                                            sizeof(directory.buffer),
+                                            FALSE,
+                                            FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                            nullptr,
+                                            &directory.overlapped,
+                                            nullptr
+                                            );
+    if (success == 0) {
+        LPTSTR error = nullptr;
+        WINDOWS_FORMAT_ERROR(error)
+        if (error != nullptr) {
+            std::cerr << "Failed to watch directory " << directory.path << '\n' << error << std::endl;
+            LocalFree(error);
+        }
+        return false;
+    }
+    return true;
+}
+}
+
+WatchControl::WatchControl() : event(CreateEvent(nullptr, FALSE, FALSE, nullptr)) {}
+
+WatchControl::~WatchControl() {
+    if (event != nullptr) {
+        CloseHandle(event);
+    }
+}
+
+void WatchControl::wake() {
+    if (event != nullptr) {
+        SetEvent(event);
+    }
+}
+
+bool watchFiles(const std::vector<std::filesystem::path> &files, std::chrono::milliseconds debounce, const WatchCallback &onChange, WatchControl *control) {
+    std::vector<std::unique_ptr<WatchedDirectory>> directories;
+    std::vector<HANDLE> events;
+    // the control's event comes first, the directories' events follow in order
+    size_t firstDirectory = 0;
+    if (control != nullptr && control->handle() != nullptr) {
+        events.push_back(control->handle());
+        firstDirectory = 1;
+    }
+    std::unordered_map<std::filesystem::path, size_t, PathHash> watched;
+    auto addWatches = [&](const std::vector<std::filesystem::path> &newFiles) {
+        for (const auto &file : newFiles) {
+            std::filesystem::path parent = file.parent_path();
+            if (watched.contains(parent)) {
+                continue;
+            }
+            if (!std::filesystem::exists(parent)) {
+                std::cerr << "Parent path " << parent << " does not exist" << std::endl;
+                return false;
+            }
+            if (events.size() == MAXIMUM_WAIT_OBJECTS) {
+                std::cerr << "Can't watch more than " << MAXIMUM_WAIT_OBJECTS << " directories" << std::endl;
+                return false;
+            }
+            auto directory = std::make_unique<WatchedDirectory>();
+            directory->path = parent;
+            directory->handle = CreateFile(parent.string().c_str(), GENERIC_READ, FILE_SHARE_VALID_FLAGS, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+            if (directory->handle == INVALID_HANDLE_VALUE) {
+                std::cerr << "Failed to open directory " << parent << "\nError code: " << GetLastError() << std::endl;
+                return false;
+            }
+            directory->overlapped.hEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+            if (!startReading(*directory)) {
+                return false;
+            }
+            watched.emplace(parent, directories.size());
+            events.push_back(directory->overlapped.hEvent);
+            directories.push_back(std::move(directory));
+        }
+        return true;
+    };
+    if (!addWatches(files)) {
+        return false;
+    }
+
+    PendingChanges pending(files);
+    while (true) {
+        DWORD timeout = pending.empty() ? INFINITE : static_cast<DWORD>(pending.remaining(debounce).count());
+        DWORD result = WaitForMultipleObjects(static_cast<DWORD>(events.size()), events.data(), FALSE, timeout);
+        if (result == WAIT_TIMEOUT) {
+            pending.setFiles(onChange(pending.take()));
+            if (!addWatches(pending.watched())) {
+                return false;
+            }
+            continue;
+        }
+        if (result < WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + events.size()) {
+            LPTSTR error = nullptr;
+            WINDOWS_FORMAT_ERROR(error)
+            if (error != nullptr) {
+                std::cerr << "Failed to wait for directory changes\n" << error << std::endl;
+                LocalFree(error);
+            }
+            return false;
+        }
+        if (result - WAIT_OBJECT_0 < firstDirectory) {
+            if (control->stopped()) {
+                return true;
+            }
+            uint64_t round = control->round();
+            pending.setFiles(onChange({}));
+            if (!addWatches(pending.watched())) {
+                return false;
+            }
+            control->watching(round);
+            continue;
+        }
+        WatchedDirectory &directory = *directories[result - WAIT_OBJECT_0 - firstDirectory];
+        DWORD transferred;
+        if (GetOverlappedResult(directory.handle, &directory.overlapped, &transferred, FALSE) == 0) {
+            LPTSTR error = nullptr;
+            WINDOWS_FORMAT_ERROR(error)
+            if (error != nullptr) {
+                std::cerr << "Failed to get overlapped result.\n" << error << std::endl;
+                LocalFree(error);
+            }
+            return false;
+        }
+
+        if (transferred != 0) {
+            auto event = reinterpret_cast<FILE_NOTIFY_INFORMATION *>(directory.buffer);
+            while (true) {
+                DWORD name_length = event->FileNameLength / sizeof(wchar_t);
+                std::wstring name(event->FileName, name_length);
+                pending.add((directory.path / name).lexically_normal());
+
+                if (event->NextEntryOffset) {
+                    *((uint8_t**)&event) += event->NextEntryOffset;
+                } else {
+                    break;
+                }
+            }
+        }
+        if (!startReading(directory)) {
+            return false;
+        }
+        if (!pending.empty() && pending.remaining(debounce).count() == 0) {
+            pending.setFiles(onChange(pending.take()));
+            if (!addWatches(pending.watched())) {
+                return false;
+            }
+        }
+    }
+}
+#endif
+#if !defined(__linux__) && !defined(_WIN32)
+WatchControl::WatchControl() = default;
+WatchControl::~WatchControl() = default;
+
+void WatchControl::wake() {}
+#endif
+
+bool WatchControl::sync() {
+#ifdef WATCH_SUPPORTED
+    std::unique_lock lock(mutex);
+    uint64_t round = ++requestedRound;
+    lock.unlock();
+    wake();
+    lock.lock();
+    watched.wait(lock, [&] { return watchedRound >= round || stopRequested; });
+    return !stopRequested;
+#else
+    return false;
+#endif
+}
+
+void WatchControl::stop() {
+    {
+        std::lock_guard lock(mutex);
+        stopRequested = true;
+    }
+    watched.notify_all();
+    wake();
+}
+
+uint64_t WatchControl::round() {
+    std::lock_guard lock(mutex);
+    return requestedRound;
+}
+
+void WatchControl::watching(uint64_t round) {
+    {
+        std::lock_guard lock(mutex);
+        watchedRound = std::max(watchedRound, round);
+    }
+    watched.notify_all();
+}
+
+#ifdef _WIN32
+namespace {
+std::atomic<WatchControl*> signalControl = nullptr;
+std::atomic<bool> signalled = false;
+
+// runs on a thread of its own
+BOOL WINAPI stopOnConsoleEvent(DWORD) {
+    WatchControl *control = signalControl;
+    if (control == nullptr || signalled.exchange(true)) {
+        // the default handler ends the process
+        return FALSE;
+    }
+    control->stop();
+    return TRUE;
+}
+}
+
+StopOnSignal::StopOnSignal(WatchControl &control) {
+    signalControl = &control;
+    SetConsoleCtrlHandler(stopOnConsoleEvent, TRUE);
+}
+
+StopOnSignal::~StopOnSignal() {
+    SetConsoleCtrlHandler(stopOnConsoleEvent, FALSE);
+    signalControl = nullptr;
+}
+#else
+StopOnSignal::StopOnSignal(WatchControl &control) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    // a handler couldn't take the control's lock, a thread waiting for the blocked signals can
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    waiter = std::thread([this, &control, signals] {
+        int signal;
+        sigwait(&signals, &signal);
+        if (done) {
+            return;
+        }
+        control.stop();
+        sigwait(&signals, &signal);
+        if (done) {
+            return;
+        }
+        std::_Exit(128 + signal);
+    });
+}
+
+StopOnSignal::~StopOnSignal() {
+    done = true;
+    pthread_kill(waiter.native_handle(), SIGTERM);
+    waiter.join();
+}
+#endif
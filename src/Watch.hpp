@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) || defined(_WIN32)
+#define WATCH_SUPPORTED 1
+#endif
+
+// returns the files to watch from now on, which lets imported libraries join the watch
+typedef std::function<std::vector<std::filesystem::path>(const std::vector<std::filesystem::path> &changed)> WatchCallback;
+
+// Lets other threads interrupt a running watchFiles call.
+class WatchControl {
+public:
+    WatchControl();
+    ~WatchControl();
+    WatchControl(const WatchControl &) = delete;
+    WatchControl &operator=(const WatchControl &) = delete;
+
+    // runs the callback without changed files, so the watch picks up the files it returns
+    void wake();
+    // wakes the watch and waits until it watches the files the callback returned
+    // returns false once the control is stopped, changes after a true return are noticed
+    bool sync();
+    // makes watchFiles return true and sync return false
+    void stop();
+    // for watchFiles: the syncs requested before the callback runs are done once its files are watched
+    [[nodiscard]] uint64_t round();
+    void watching(uint64_t round);
+
+    [[nodiscard]] bool stopped() const {
+        return stopRequested;
+    }
+#ifdef __linux__
+    // eventfd that becomes readable on wake and stop
+    [[nodiscard]] int handle() const {
+        return fd;
+    }
+#endif
+#ifdef _WIN32
+    // auto-reset event that gets set on wake and stop
+    [[nodiscard]] void *handle() const {
+        return event;
+    }
+#endif
+
+private:
+    std::atomic<bool> stopRequested = false;
+    std::mutex mutex;
+    std::condition_variable watched;
+    uint64_t requestedRound = 0;
+    uint64_t watchedRound = 0;
+#ifdef __linux__
+    int fd;
+#endif
+#ifdef _WIN32
+    void *event;
+#endif
+};
+
+// Watches the parent directories of the files and blocks until a change arrives.
+// Changes are collected until none arrived for the debounce window, so editors that write in
+// several chunks only trigger one callback. The changed files are passed in watch order.
+// Only returns on failure, or with true once the control is stopped.
+bool watchFiles(const std::vector<std::filesystem::path> &files, std::chrono::milliseconds debounce, const WatchCallback &onChange, WatchControl *control = nullptr);
+
+// Stops the control on SIGINT or SIGTERM, Ctrl+C or closing the console on Windows, for as long as it exists.
+// A second one ends the process right away. Create it before starting any threads, they have to inherit
+// the blocked signals, which stay blocked afterwards.
+class StopOnSignal {
+public:
+    explicit StopOnSignal(WatchControl &control);
+    ~StopOnSignal();
+    StopOnSignal(const StopOnSignal &) = delete;
+    StopOnSignal &operator=(const StopOnSignal &) = delete;
+
+private:
+#ifndef _WIN32
+    std::atomic<bool> done = false;
+    std::thread waiter;
+#endif
+};
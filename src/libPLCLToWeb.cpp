@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <chrono>
+#include <libPLCL.hpp>
+
+#include "libPLCLToWeb.hpp"
+#include "CSS.hpp"
+#include "Diagnostics.hpp"
+#include "EmitCpp.hpp"
+#include "HTML.hpp"
+#include "Libraries.hpp"
+#include "RenderPlan.hpp"
+#include "Sink.hpp"
+#include "Trace.hpp"
+
+using namespace PLCL;
+
+namespace {
+
+// walks the lists with a stack of elements, so deep documents don't recurse
+void countLists(const auto &lists, PLCLToWeb::Statistics &statistics) {
+    std::vector<const Config::ConfigElement*> pending;
+    auto pushLists = [&pending](const auto &lists) {
+        for (const auto &list : lists) {
+            for (const auto &listElement : list->elements) {
+                if (listElement->element != nullptr) {
+                    pending.push_back(listElement->element);
+                }
+            }
+        }
+    };
+    pushLists(lists);
+    while (!pending.empty()) {
+        const Config::ConfigElement *element = pending.back();
+        pending.pop_back();
+        statistics.elements++;
+        statistics.attributes += element->attributes.size();
+        pushLists(element->lists);
+    }
+}
+
+void countElement(const Config::ConfigElement &element, PLCLToWeb::Statistics &statistics) {
+    statistics.elements++;
+    statistics.attributes += element.attributes.size();
+    countLists(element.lists, statistics);
+}
+
+bool render(std::string_view source, PLCLToWeb::Language language, const PLCLToWeb::Options &options, OutputSink &output, PLCLToWeb::Statistics &statistics) {
+    using Clock = std::chrono::steady_clock;
+    statistics.bytesIn = source.size();
+    try {
+        Clock::time_point start = Clock::now();
+        // nested in the file's span, the phases are told apart by name
+        std::optional<TraceSpan> span(std::in_place, "compile", "parse");
+        Config::ConfigRoot config = Config::ConfigRoot::fromString(std::string(source));
+        statistics.parse = Clock::now() - start;
+        for (const auto &element : config.elements) {
+            countElement(*element, statistics);
+        }
+        countLists(config.lists, statistics);
+
+        span.emplace("compile", "imports");
+        start = Clock::now();
+        std::vector<std::shared_ptr<const TemplateLibrary>> libraries = templateLibraries().resolve(options.path, config);
+        statistics.imports = Clock::now() - start;
+
+        span.emplace("compile", "render");
+        start = Clock::now();
+        // flushes into the sink while rendering are counted as writing
+        std::chrono::nanoseconds writeBefore = statistics.write;
+        if (language == PLCLToWeb::Language::CSS) {
+            std::vector<const Config::ConfigRoot*> imports;
+            imports.reserve(libraries.size());
+            for (const auto &library : libraries) {
+                imports.push_back(&library->root);
+            }
+            output << parseCSS(config, options.minify, options.indent, imports, &statistics.templateInstantiations);
+        } else {
+            std::vector<const TemplateRegistry*> imports;
+            imports.reserve(libraries.size());
+            for (const auto &library : libraries) {
+                imports.push_back(&library->templates);
+            }
+            // emitted headers don't depend on the thread count, identical instantiations always share a call
+            RenderPlan plan = compileHTML(config, options.minify, options.indent, imports, options.emitCpp ? 1 : options.renderThreads);
+            statistics.templateInstantiations = plan.instantiations;
+            if (options.emitCpp) {
+                // the generated namespace is named after the file
+                std::filesystem::path file = options.path.empty() ? std::filesystem::path("document.p(l)clhtml") : options.path;
+                emitCpp(plan, file, output);
+            } else {
+                std::optional<FragmentCache> fragments;
+                if (options.fragmentCache) {
+                    fragments.emplace();
+                }
+                renderPlan(plan, output, fragments ? &*fragments : nullptr, options.renderThreads);
+                if (fragments) {
+                    statistics.fragmentCacheHits = fragments->hits;
+                    statistics.fragmentCacheMisses = fragments->misses;
+                }
+            }
+        }
+        statistics.render = Clock::now() - start - (statistics.write - writeBefore);
+    } catch (const std::exception &exception) {
+        diagnostic() << exception.what();
+        return false;
+    }
+    return true;
+}
+
+void compileInto(std::string_view source, PLCLToWeb::Language language, const PLCLToWeb::Options &options, OutputSink &output, PLCLToWeb::Result &result) {
+    DiagnosticsCollect collect(result.diagnostics);
+    result.success = render(source, language, options, output, result.statistics);
+}
+
+}
+
+namespace PLCLToWeb {
+    std::optional<Language> languageOf(const std::filesystem::path &file) {
+        std::string extension = file.extension().string();
+        if (Generic::iequals(extension, ".p(l)clhtml")) {
+            return Language::HTML;
+        }
+        if (Generic::iequals(extension, ".p(l)clcss")) {
+            return Language::CSS;
+        }
+        return std::nullopt;
+    }
+
+    Result compile(std::string_view source, Language language, const Options &options, std::string &output) {
+        Result result;
+        OutputSink sink;
+        compileInto(source, language, options, sink, result);
+        result.statistics.bytesOut = sink.size();
+        if (output.empty()) {
+            output = sink.take();
+        } else {
+            output += sink.take();
+        }
+        return result;
+    }
+
+    Result compile(std::string_view source, Language language, const Options &options, const Sink &sink) {
+        Result result;
+        OutputSink output([&sink, &statistics = result.statistics](std::string_view chunk) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            sink(chunk);
+            statistics.write += std::chrono::steady_clock::now() - start;
+        });
+        compileInto(source, language, options, output, result);
+        output.flush();
+        result.statistics.bytesOut = output.size();
+        return result;
+    }
+
+    std::ostream &operator<<(std::ostream &stream, const Diagnostic &diagnostic) {
+        if (!diagnostic.source.empty()) {
+            stream << "(" << diagnostic.source << ") ";
+        }
+        return stream << diagnostic.message;
+    }
+}
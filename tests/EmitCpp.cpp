@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <array>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <libPLCLToWeb.hpp>
+
+// generated from tests/emit/components.p(l)clhtml by PLCLToWeb --emit-cpp while building the tests
+#include "components.hpp"
+#include "Test.hpp"
+
+namespace {
+
+// the HTML PLCLToWeb writes for the document, which the header has to render too
+std::string compiledHTML() {
+    std::filesystem::path file = std::filesystem::path(PLCLToWeb_TESTS_DIR) / "emit" / "components.p(l)clhtml";
+    PLCLToWeb::Options options;
+    options.path = file;
+    std::string output;
+    PLCLToWeb::Result result = PLCLToWeb::compile(Test::readFile(file), PLCLToWeb::Language::HTML, options, output);
+    CHECK(result.success);
+    CHECK(result.diagnostics.empty());
+    return output;
+}
+
+void replace(std::string &text, std::string_view from, std::string_view to) {
+    size_t position = text.find(from);
+    REQUIRE(position != std::string::npos);
+    text.replace(position, from.size(), to);
+}
+
+}
+
+TEST(emit_cpp_defaults) {
+    std::string html;
+    components_html::render(html);
+    CHECK_EQUAL(html, compiledHTML());
+}
+
+// the values the page passes to its templates can be replaced, and are escaped like the document's
+TEST(emit_cpp_variables) {
+    static constexpr std::array<std::string_view, 3> ITEMS = {"a", "b", "c"};
+    components_html::Variables variables;
+    variables.Card_1_title = "Replaced & <escaped>";
+    variables.Card_0_2nditems = ITEMS;
+    variables.Card_0_kind = "\"kind\"";
+    std::string html;
+    components_html::render(html, variables);
+
+    std::string expected = compiledHTML();
+    replace(expected, "<h2>Second</h2>", "<h2>Replaced &amp; &lt;escaped&gt;</h2>");
+    replace(expected, "<li>one</li><li>&lt;two&gt;</li>", "<li>a</li><li>b</li><li>c</li>");
+    replace(expected, "data-kind=\"news\"", "data-kind=\"&quot;kind&quot;\"");
+    CHECK_EQUAL(html, expected);
+}
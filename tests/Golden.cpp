@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <filesystem>
+#include <iterator>
+#include <optional>
+#include <libPLCLToWeb.hpp>
+
+#include "Test.hpp"
+
+namespace {
+
+// The expected output of every example, written by the tree before the render plan, the CSS emitter
+// rewrite and the parallel renderers. The only intended difference is the & escaped in attribute values.
+struct Mode {
+    std::string_view directory;
+    bool minify;
+    size_t indent;
+};
+
+constexpr Mode MODES[] = {
+    {"minified", true, 4},
+    {"indent2", false, 2},
+};
+
+void compareExamples(size_t threads, bool fragmentCache) {
+    size_t compared = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(PLCLToWeb_EXAMPLES_DIR)) {
+        std::optional<PLCLToWeb::Language> language = PLCLToWeb::languageOf(entry.path());
+        if (!language) {
+            continue;
+        }
+        std::string source = Test::readFile(entry.path());
+        std::filesystem::path golden = entry.path().filename().replace_extension(*language == PLCLToWeb::Language::HTML ? ".html" : ".css");
+        for (const Mode &mode : MODES) {
+            PLCLToWeb::Options options;
+            options.minify = mode.minify;
+            options.indent = mode.indent;
+            options.fragmentCache = fragmentCache;
+            options.renderThreads = threads;
+            options.path = entry.path();
+            std::string output;
+            PLCLToWeb::Result result = PLCLToWeb::compile(source, *language, options, output);
+            CHECK(result.success);
+            CHECK(result.diagnostics.empty());
+            CHECK_EQUAL(output, Test::readFile(std::filesystem::path(PLCLToWeb_GOLDEN_DIR) / mode.directory / golden));
+            compared++;
+        }
+    }
+    CHECK(compared >= 3 * std::size(MODES));
+}
+
+}
+
+TEST(golden_examples) {
+    compareExamples(1, false);
+}
+
+TEST(golden_examples_fragment_cache) {
+    compareExamples(1, true);
+}
+
+TEST(golden_examples_threads) {
+    compareExamples(4, true);
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "Test.hpp"
+
+namespace {
+
+bool failed = false;
+
+}
+
+namespace Test {
+    std::vector<Case> &cases() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    void fail(const char *file, int line, const std::string &message) {
+        failed = true;
+        std::cerr << file << ":" << line << ": " << message << std::endl;
+    }
+
+    void checkEqual(std::string_view actual, std::string_view expected, const char *expression, const char *file, int line) {
+        if (actual == expected) {
+            return;
+        }
+        size_t position = std::ranges::mismatch(actual, expected).in1 - actual.begin();
+        size_t context = std::min<size_t>(position, 40);
+        std::ostringstream message;
+        message << expression << ": differs at byte " << position << " of " << actual.size() << " (expected " << expected.size() << ")\n"
+                << "  got:      " << actual.substr(position - context, 80) << "\n"
+                << "  expected: " << expected.substr(position - context, 80);
+        fail(file, line, message.str());
+    }
+
+    std::string readFile(const std::filesystem::path &file) {
+        std::ifstream ifs(file, std::ios::binary);
+        if (!ifs) {
+            fail(__FILE__, __LINE__, "Failed to open " + file.string());
+            throw Abort();
+        }
+        return {std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    }
+}
+
+// runs the tests whose name starts with the argument, or every test without one
+int main(int argc, char *argv[]) {
+    std::string_view prefix = argc > 1 ? argv[1] : "";
+    size_t run = 0;
+    for (const Test::Case &test : Test::cases()) {
+        if (!test.name.starts_with(prefix)) {
+            continue;
+        }
+        bool failedBefore = failed;
+        failed = false;
+        try {
+            test.run();
+        } catch (const Test::Abort &) {
+        } catch (const std::exception &exception) {
+            Test::fail(__FILE__, __LINE__, std::string("Unexpected exception: ") + exception.what());
+        }
+        std::cout << (failed ? "FAIL " : "ok   ") << test.name << std::endl;
+        failed = failed || failedBefore;
+        run++;
+    }
+    if (run == 0) {
+        std::cerr << "No test starts with " << prefix << std::endl;
+        return EXIT_FAILURE;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+#include <libPLCL.hpp>
+
+#include "Documents.hpp"
+#include "Allocations.hpp"
+#include "Diagnostics.hpp"
+#include "HTML.hpp"
+#include "RenderPlan.hpp"
+#include "Test.hpp"
+
+namespace {
+
+// once set, the allocation it counts down to throws, on whatever thread it happens
+std::atomic<long> allocationsUntilFailure = 0;
+
+}
+
+// replaced for the whole test binary, so parallel work can be made to fail in the middle and its
+// allocations counted like the executable does
+void *operator new(std::size_t size) {
+    if (allocationsUntilFailure.load(std::memory_order_relaxed) > 0 && allocationsUntilFailure.fetch_sub(1) == 1) {
+        throw std::bad_alloc();
+    }
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        AllocationTracker::allocated(pointer);
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept {
+    AllocationTracker::freed(pointer);
+    std::free(pointer);
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    ::operator delete(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    ::operator delete(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+    ::operator delete(pointer);
+}
+
+namespace {
+
+// renders the document compiled and rendered on threads threads
+std::string render(const Config::ConfigRoot &root, bool minify, size_t threads, bool fragmentCache) {
+    RenderPlan plan = compileHTML(root, minify, 2, {}, threads);
+    std::optional<FragmentCache> fragments;
+    if (fragmentCache) {
+        fragments.emplace();
+    }
+    OutputSink output;
+    renderPlan(plan, output, fragments ? &*fragments : nullptr, threads);
+    return output.take();
+}
+
+// the plan split across threads has to render what the plan compiled and rendered in a row does
+void compareThreads(const Document &document) {
+    Config::ConfigRoot root = Config::ConfigRoot::fromString(document.source);
+    for (bool minify : {true, false}) {
+        std::string expected = render(root, minify, 1, false);
+        CHECK(!expected.empty());
+        for (size_t threads : {2, 4, 8}) {
+            CHECK_EQUAL(render(root, minify, threads, false), expected);
+            CHECK_EQUAL(render(root, minify, threads, true), expected);
+        }
+    }
+}
+
+}
+
+// mostly static, one list of the document large enough to lower in segments
+TEST(parallel_wide) {
+    compareThreads(wideDocument(20000));
+}
+
+// a call per instantiation, enough root instructions to render in segments too
+TEST(parallel_templates) {
+    compareThreads(templateDocument(4, 6000));
+}
+
+// diagnostics of the segments are reported in the order of the document
+TEST(parallel_diagnostics) {
+    DocumentWriter writer("diagnostics");
+    writer.beginList("_Templates");
+    writer.beginElement("Template");
+    writer.attribute("Name", "Component");
+    writer.beginList("Elements");
+    writer.beginElement("P");
+    writer.endElement();
+    writer.endList();
+    writer.endElement();
+    writer.endList();
+    writer.beginElement("Html");
+    writer.beginList("Elements");
+    // every instantiation reports an element of its own in its _VariableValues
+    for (size_t i = 0; i < 6000; i++) {
+        writer.beginElement("Component");
+        writer.beginList("VariableValues");
+        writer.beginElement("Unexpected" + std::to_string(i));
+        writer.endElement();
+        writer.endList();
+        writer.endElement();
+    }
+    writer.endList();
+    writer.endElement();
+    Config::ConfigRoot root = Config::ConfigRoot::fromString(writer.take());
+
+    std::vector<PLCLToWeb::Diagnostic> expected;
+    {
+        DiagnosticsCollect collect(expected);
+        render(root, true, 1, false);
+    }
+    CHECK_EQUAL(expected.size(), size_t(6000));
+    std::vector<PLCLToWeb::Diagnostic> actual;
+    {
+        DiagnosticsCollect collect(actual);
+        render(root, true, 4, false);
+    }
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        CHECK_EQUAL(actual[i].source, expected[i].source);
+        CHECK_EQUAL(actual[i].message, expected[i].message);
+    }
+}
+
+// segments compiled and rendered on pool threads count for the thread the document is for, helpers
+// with fragment caches of their own can only allocate more than a single thread
+TEST(parallel_allocations) {
+    Config::ConfigRoot root = Config::ConfigRoot::fromString(templateDocument(4, 6000).source);
+    size_t serial;
+    {
+        AllocationTracker tracker;
+        render(root, true, 1, true);
+        serial = tracker.allocations();
+    }
+    for (size_t threads : {2, 4, 8}) {
+        AllocationTracker tracker;
+        render(root, true, threads, true);
+        CHECK(tracker.allocations() >= serial * 9 / 10);
+    }
+}
+
+// A compile or render failing on any thread, in a segment, while splicing or writing, has to leave
+// nothing running that uses the plan or the document. Meant to run under -DPLCLToWeb_SANITIZE=address
+// or thread, which catch the helpers that would outlive them.
+TEST(parallel_exceptions) {
+    Document document = templateDocument(4, 6000);
+    std::string expected;
+    {
+        Config::ConfigRoot root = Config::ConfigRoot::fromString(document.source);
+        expected = render(root, true, 1, true);
+    }
+    size_t failed = 0;
+    for (long allocation : {1, 2, 3, 5, 10, 50, 100, 500, 1000, 5000, 10000, 20000, 50000}) {
+        Config::ConfigRoot root = Config::ConfigRoot::fromString(document.source);
+        RenderPlan plan = compileHTML(root, true, 2, {}, 1);
+        // the render on its own, then the compile and the render
+        for (bool compile : {false, true}) {
+            std::string output;
+            allocationsUntilFailure = allocation;
+            try {
+                if (compile) {
+                    output = render(root, true, 4, true);
+                } else {
+                    FragmentCache fragments;
+                    OutputSink sink;
+                    renderPlan(plan, sink, &fragments, 4);
+                    output = sink.take();
+                }
+            } catch (const std::bad_alloc &) {
+                failed++;
+            }
+            allocationsUntilFailure = 0;
+            if (!output.empty()) {
+                CHECK_EQUAL(output, expected);
+            }
+        }
+    }
+    // the counts are small enough for most runs to fail
+    CHECK(failed > 0);
+}
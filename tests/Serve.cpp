@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <libPLCLToWeb.hpp>
+
+#include "ServeProtocol.hpp"
+#include "Test.hpp"
+
+namespace {
+
+// what a client sends for the request, the inverse of parseHeader
+std::vector<std::string> requestHeader(const Request &request) {
+    std::vector<std::string> lines;
+    if (!request.file.empty()) {
+        lines.push_back("File: " + request.file.string());
+    }
+    if (request.sourceLength) {
+        lines.push_back("Source-Length: " + std::to_string(*request.sourceLength));
+    }
+    if (request.language) {
+        lines.push_back(std::string("Language: ") + (*request.language == PLCLToWeb::Language::HTML ? "html" : "css"));
+    }
+    if (!request.options.path.empty()) {
+        lines.push_back("Path: " + request.options.path.string());
+    }
+    if (!request.output.empty()) {
+        lines.push_back("Output: " + request.output.string());
+    }
+    lines.push_back(std::string("Minify: ") + (request.options.minify ? "yes" : "no"));
+    lines.push_back("Indent: " + std::to_string(request.options.indent));
+    lines.push_back(std::string("Emit-Cpp: ") + (request.options.emitCpp ? "yes" : "no"));
+    return lines;
+}
+
+Request parseRequest(const std::vector<std::string> &lines) {
+    Request request;
+    for (const auto &line : lines) {
+        CHECK_EQUAL(parseHeader(line, request), "");
+    }
+    return request;
+}
+
+void checkRoundTrip(const Request &request) {
+    Request parsed = parseRequest(requestHeader(request));
+    CHECK_EQUAL(parsed.file.string(), request.file.string());
+    CHECK(parsed.sourceLength == request.sourceLength);
+    CHECK(parsed.language == request.language);
+    CHECK_EQUAL(parsed.output.string(), request.output.string());
+    CHECK_EQUAL(parsed.options.path.string(), request.options.path.string());
+    CHECK_EQUAL(parsed.options.minify, request.options.minify);
+    CHECK_EQUAL(parsed.options.indent, request.options.indent);
+    CHECK_EQUAL(parsed.options.emitCpp, request.options.emitCpp);
+}
+
+// what a client reads from a response header
+struct Response {
+    std::string status;
+    std::vector<std::string> diagnostics;
+    std::string error;
+    std::string length;
+};
+
+Response parseResponse(std::string_view text) {
+    Response response;
+    REQUIRE(text.ends_with("\n\n"));
+    text.remove_suffix(2);
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? "" : text.substr(end + 1);
+        size_t colon = line.find(": ");
+        REQUIRE(colon != std::string_view::npos);
+        std::string_view name = line.substr(0, colon);
+        std::string value(line.substr(colon + 2));
+        if (name == "Status") {
+            response.status = value;
+        } else if (name == "Diagnostic") {
+            response.diagnostics.push_back(value);
+        } else if (name == "Error") {
+            response.error = value;
+        } else if (name == "Length") {
+            response.length = value;
+        } else {
+            Test::fail(__FILE__, __LINE__, "Unknown response header " + std::string(name));
+        }
+    }
+    return response;
+}
+
+}
+
+TEST(serve_request_round_trip) {
+    Request file;
+    file.file = std::filesystem::absolute("pages/index.p(l)clhtml").lexically_normal();
+    file.output = std::filesystem::absolute("out").lexically_normal();
+    file.options.minify = false;
+    file.options.indent = 2;
+    checkRoundTrip(file);
+
+    Request source;
+    source.sourceLength = 1234;
+    source.language = PLCLToWeb::Language::CSS;
+    source.options.path = std::filesystem::absolute("styles/site.p(l)clcss").lexically_normal();
+    source.options.emitCpp = true;
+    checkRoundTrip(source);
+}
+
+TEST(serve_request_errors) {
+    Request request;
+    // names and yes or no are case insensitive, values are trimmed
+    CHECK_EQUAL(parseHeader("minify:   YES", request), "");
+    CHECK(request.options.minify);
+    CHECK_EQUAL(parseHeader("language: Html", request), "");
+    CHECK(request.language == PLCLToWeb::Language::HTML);
+    CHECK_EQUAL(parseHeader("Minify", request), "Expected \"Name: value\", got Minify");
+    CHECK_EQUAL(parseHeader("Minify: maybe", request), "Expected yes or no after Minify");
+    CHECK_EQUAL(parseHeader("Indent: -1", request), "Expected a size after Indent");
+    CHECK_EQUAL(parseHeader("Source-Length: ", request), "Expected a size after Source-Length");
+    CHECK_EQUAL(parseHeader("Language: js", request), "Expected html or css after Language");
+    CHECK_EQUAL(parseHeader("Colour: blue", request), "Unknown header Colour");
+}
+
+TEST(serve_response_round_trip) {
+    std::vector<PLCLToWeb::Diagnostic> diagnostics = {{"Html.Elements[0]", "Unknown element"}, {"", "Failed to open\nsomewhere"}};
+    Response parsed = parseResponse(response("failed", diagnostics, 42));
+    CHECK_EQUAL(parsed.status, "failed");
+    REQUIRE(parsed.diagnostics.size() == diagnostics.size());
+    // every diagnostic stays on its own line
+    CHECK(parsed.diagnostics[1].find('\n') == std::string::npos);
+    CHECK(parsed.diagnostics[1].find("Failed to open somewhere") != std::string::npos);
+    CHECK(parsed.diagnostics[0].find("Unknown element") != std::string::npos);
+    CHECK_EQUAL(parsed.length, "42");
+
+    parsed = parseResponse(response("ok", {}, 0));
+    CHECK_EQUAL(parsed.status, "ok");
+    CHECK(parsed.diagnostics.empty());
+    CHECK_EQUAL(parsed.length, "0");
+
+    parsed = parseResponse(errorResponse("Unknown header\nColour"));
+    CHECK_EQUAL(parsed.status, "error");
+    CHECK_EQUAL(parsed.error, "Unknown header Colour");
+    CHECK_EQUAL(parsed.length, "0");
+}
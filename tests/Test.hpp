@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// A minimal test runner, so the tests need nothing but the library. TEST registers a function,
+// CHECK and CHECK_EQUAL record a failure and let the test go on, REQUIRE ends it.
+namespace Test {
+    struct Case {
+        std::string_view name;
+        void (*run)();
+    };
+
+    std::vector<Case> &cases();
+
+    struct Register {
+        Register(std::string_view name, void (*run)()) {
+            cases().push_back({name, run});
+        }
+    };
+
+    // thrown by REQUIRE, ends the current test
+    struct Abort {};
+
+    void fail(const char *file, int line, const std::string &message);
+
+    // the first difference of long outputs is more useful than both of them
+    void checkEqual(std::string_view actual, std::string_view expected, const char *expression, const char *file, int line);
+
+    template<typename A, typename E>
+    void checkEqual(const A &actual, const E &expected, const char *expression, const char *file, int line) {
+        if constexpr (std::is_convertible_v<const A&, std::string_view> && std::is_convertible_v<const E&, std::string_view>) {
+            checkEqual(std::string_view(actual), std::string_view(expected), expression, file, line);
+        } else if (!(actual == expected)) {
+            std::ostringstream message;
+            message << expression << ": got " << actual << ", expected " << expected;
+            fail(file, line, message.str());
+        }
+    }
+
+    std::string readFile(const std::filesystem::path &file);
+}
+
+#define TEST(name) \
+    static void test_##name(); \
+    static const Test::Register register_##name(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            Test::fail(__FILE__, __LINE__, #condition); \
+        } \
+    } while (false)
+
+#define REQUIRE(condition) \
+    do { \
+        if (!(condition)) { \
+            Test::fail(__FILE__, __LINE__, #condition); \
+            throw Test::Abort(); \
+        } \
+    } while (false)
+
+#define CHECK_EQUAL(actual, expected) Test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)